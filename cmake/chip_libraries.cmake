@@ -3,6 +3,7 @@
 #
 # MCU_PLATFORM      A supported microcontroller platform.
 #                   For example '43xx_m4' or '43xx_m0'.
+#                   Use 'host' for a native (Linux / macOS) build.
 
 if(NOT DEFINED MCU_PLATFORM)
     message(FATAL_ERROR "${CPM_MODULE_NAME}: \
@@ -42,6 +43,10 @@ elseif("${MCU_PLATFORM}" STREQUAL "lpc11xxx")
         GIT_REPOSITORY "https://github.com/JitterCompany/chip_${MCU_PLATFORM}.git"
         GIT_TAG "1.4.4")
 
+elseif("${MCU_PLATFORM}" STREQUAL "host")
+    message(STATUS "${CPM_MODULE_NAME}: Platform '${MCU_PLATFORM}' detected")
+    add_definitions(-DMCU_PLATFORM_host)
+
 else()
     message(FATAL_ERROR "${CPM_MODULE_NAME}: platform '${MCU_PLATFORM}' not supported")
 endif()
@@ -0,0 +1,85 @@
+#ifndef ATOMIC_U32_H
+#define ATOMIC_U32_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Minimal atomic operations on 32-bit words, safe between interrupts and
+ * the main loop (and between threads on the host).
+ *
+ * Cortex-M3/M4 and the host use the compiler builtins (LDREX/STREX on ARM).
+ * ARMv6-M (Cortex-M0) has no exclusive access instructions: there the
+ * read-modify-write is done with interrupts masked for a few instructions.
+ * That is safe against interrupts, but not against another core.
+ */
+
+#if defined(__ARM_ARCH_6M__)
+
+static inline uint32_t atomic_u32_irq_save(void)
+{
+    uint32_t primask;
+    __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+    return primask;
+}
+
+static inline void atomic_u32_irq_restore(uint32_t primask)
+{
+    __asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+}
+
+static inline uint32_t atomic_u32_fetch_add(volatile uint32_t *value, uint32_t add)
+{
+    const uint32_t primask = atomic_u32_irq_save();
+    const uint32_t old = *value;
+    *value = old + add;
+    atomic_u32_irq_restore(primask);
+    return old;
+}
+
+// If *value equals *expected, replace it with 'desired' and return true.
+// Otherwise, update *expected with the current value and return false.
+static inline bool atomic_u32_cas(volatile uint32_t *value, uint32_t *expected,
+        uint32_t desired)
+{
+    const uint32_t primask = atomic_u32_irq_save();
+    const uint32_t old = *value;
+    const bool match = (old == *expected);
+    if(match) {
+        *value = desired;
+    }
+    atomic_u32_irq_restore(primask);
+    *expected = old;
+    return match;
+}
+
+#else
+
+static inline uint32_t atomic_u32_fetch_add(volatile uint32_t *value, uint32_t add)
+{
+    return __atomic_fetch_add(value, add, __ATOMIC_ACQ_REL);
+}
+
+// If *value equals *expected, replace it with 'desired' and return true.
+// Otherwise, update *expected with the current value and return false.
+static inline bool atomic_u32_cas(volatile uint32_t *value, uint32_t *expected,
+        uint32_t desired)
+{
+    return __atomic_compare_exchange_n(value, expected, desired, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+#endif
+
+static inline uint32_t atomic_u32_load(volatile uint32_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+// Store with release semantics: earlier writes are visible before this one
+static inline void atomic_u32_store(volatile uint32_t *value, uint32_t desired)
+{
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef DEADLINE_HEAP_H
+#define DEADLINE_HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Marks an id that is not in the heap
+#define DEADLINE_HEAP_NONE (0xFFFF)
+
+typedef struct {
+    uint64_t deadline;
+    uint16_t id;
+} DeadlineHeapNode;
+
+typedef struct {
+    DeadlineHeapNode *nodes;
+    uint16_t *positions;
+    uint16_t capacity;
+    uint16_t size;
+} DeadlineHeap;
+
+/**
+ * Initialize a binary min-heap of deadlines.
+ *
+ * Each element is identified by an id in the range [0, capacity).
+ * The caller owns the element data (callbacks etc), the heap only tracks
+ * the deadline per id. This allows O(1) access to the earliest deadline and
+ * O(log n) insert, re-schedule and removal of any id.
+ *
+ * @param nodes         Storage for the heap: array of 'capacity' nodes
+ * @param positions     Storage for the id -> heap position lookup:
+ *                      array of 'capacity' entries
+ * @param capacity      Max amount of elements (max 0xFFFE)
+ */
+void deadline_heap_init(DeadlineHeap *heap, DeadlineHeapNode *nodes,
+        uint16_t *positions, uint16_t capacity);
+
+/**
+ * Insert an id, or move it to a new deadline if it is already in the heap.
+ */
+bool deadline_heap_set(DeadlineHeap *heap, uint16_t id, uint64_t deadline);
+
+/**
+ * Remove an id from the heap.
+ *
+ * @return  True if the id was removed, false if it was not in the heap
+ */
+bool deadline_heap_remove(DeadlineHeap *heap, uint16_t id);
+
+/**
+ * Check if an id is in the heap.
+ */
+bool deadline_heap_contains(const DeadlineHeap *heap, uint16_t id);
+
+/**
+ * Get the id with the earliest deadline.
+ *
+ * @param deadline      Optional (may be NULL): set to the earliest deadline
+ *
+ * @return              The id with the earliest deadline, or
+ *                      DEADLINE_HEAP_NONE if the heap is empty
+ */
+uint16_t deadline_heap_peek(const DeadlineHeap *heap, uint64_t *deadline);
+
+/**
+ * Remove and return the id with the earliest deadline,
+ * if that deadline is at or before 'now'.
+ *
+ * @return  The expired id, or DEADLINE_HEAP_NONE if nothing expired yet
+ */
+uint16_t deadline_heap_pop_expired(DeadlineHeap *heap, uint64_t now);
+
+/**
+ * Get the earliest 'latest deadline': the minimum of deadline + slack[id]
+ * over all ids. With a slack window per id (the deadline is the earliest
+ * time, deadline + slack the latest), this is the last moment at which all
+ * ids whose window is open can be handled at once.
+ *
+ * Only the nodes with a deadline before the result are visited, so this is
+ * cheap if few windows overlap.
+ *
+ * @param slack     Slack per id (indexed by id, 'capacity' entries)
+ * @param latest    Set to the result if the heap is not empty
+ *
+ * @return          False if the heap is empty
+ */
+bool deadline_heap_peek_latest(const DeadlineHeap *heap,
+        const uint64_t *slack, uint64_t *latest);
+
+#endif
@@ -24,6 +24,37 @@ typedef struct {
 #endif
 
 
+// With DELAY_US_SLEEP=1, delay_us() sleeps instead of polling the timer for
+// the whole delay: see delay_us_sleep().
+#if (!defined(DELAY_US_SLEEP))
+    #define DELAY_US_SLEEP (0)
+#endif
+
+// delay_us_sleep() wakes up this many microseconds before the end of the
+// delay, and polls the timer for the rest. This should cover the wake-up
+// latency (interrupt entry, other interrupts that run first).
+#if (!defined(DELAY_SPIN_US))
+    #define DELAY_SPIN_US (20)
+#endif
+
+// With DELAY_TIMER_FULL_RATE=1, the timer is not prescaled: one tick is one
+// timer clock cycle instead of (about) one microsecond. This gives sub-
+// microsecond resolution for short measurements (e.g. profile), at the cost
+// of more frequent overflow interrupts (every 2^32 ticks).
+// On the host, ticks are nanoseconds instead of microseconds.
+// Convert ticks with delay_ticks_to_ns() and friends.
+#if (!defined(DELAY_TIMER_FULL_RATE))
+    #define DELAY_TIMER_FULL_RATE (0)
+#endif
+
+// Period of the interrupt that maintains delay_get_timestamp_coarse(), in
+// milliseconds. 0 disables the interrupt: delay_get_timestamp_coarse() then
+// converts delay_get_timestamp() instead.
+#if (!defined(DELAY_COARSE_PERIOD_MS))
+    #define DELAY_COARSE_PERIOD_MS (0)
+#endif
+
+
 #if (DELAY_OWNER)
 
 /**
@@ -68,6 +99,50 @@ void delay_deinit(void);
  */
 uint64_t delay_get_timestamp(void);
 
+/* Get the tick rate of delay_get_timestamp() in Hz.
+ *
+ * By default this is about 1 MHz: the timer clock divided by an integer
+ * prescaler, so the exact rate depends on the clock (e.g. 1041666 Hz for a
+ * 12.5 MHz timer clock). With DELAY_TIMER_FULL_RATE, it is the timer clock.
+ * The rate is determined by delay_init() and delay_reinit().
+ */
+uint32_t delay_get_tick_rate(void);
+
+/* Convert between ticks and nanoseconds / microseconds.
+ *
+ * These use a fixed-point multiplier and shift that are precomputed by
+ * delay_init() for the current tick rate: there is no division at runtime.
+ * The relative error is below 1e-9, far less than the tolerance of the
+ * timer clock itself. Conversions to ticks are rounded up (a timeout never
+ * ends early). Conversions from ticks are rounded down, but never below the
+ * exact result: e.g. 204 ticks at 204 MHz are always 1 microsecond.
+ * Differences of timestamps are converted like this:
+ * delay_ticks_to_ns(end - start).
+ */
+uint64_t delay_ticks_to_ns(uint64_t ticks);
+uint64_t delay_ns_to_ticks(uint64_t nanoseconds);
+uint64_t delay_ticks_to_us(uint64_t ticks);
+uint64_t delay_us_to_ticks(uint64_t microseconds);
+
+/* Get a coarse timestamp in milliseconds since startup (wraps after 49.7 days)
+ *
+ * This is a single word read from RAM, so it is much cheaper than
+ * delay_get_timestamp(), for callers that only need millisecond resolution
+ * (logging, idle timeouts, ...). The value is updated by a timer match
+ * interrupt every DELAY_COARSE_PERIOD_MS. The period should be less than
+ * 2^32 ticks (e.g. 21 seconds for a 204 MHz DELAY_TIMER_FULL_RATE timer).
+ *
+ * Resolution: the result is at most DELAY_COARSE_PERIOD_MS (plus the latency
+ * of the delay timer interrupt) behind the time in milliseconds, and
+ * never ahead of it. If that interrupt is blocked for more than a period,
+ * the coarse time stands still until the interrupt runs, and then catches up
+ * with the current time.
+ *
+ * On the host, CLOCK_MONOTONIC_COARSE is used (resolution: one kernel tick,
+ * typically 1..4 ms).
+ */
+uint32_t delay_get_timestamp_coarse(void);
+
 /* Calculate the time diference in microseconds between two timestamps
  *
  * @param start_timestamp       timestamp from delay_get_timestamp()
@@ -90,6 +165,22 @@ uint64_t delay_calc_time_us(uint64_t start_timestamp, uint64_t end_timestamp);
  */
 void delay_us(uint64_t microseconds);
 
+/* Delay by sleeping, then polling the timer for the last DELAY_SPIN_US.
+ *
+ * On the MCU, a delay_timer alarm wakes the core from WFI shortly before the
+ * end of the delay. While sleeping, the timer is not read at all. That saves
+ * CPU time and bus traffic, e.g. when the timer is shared between cores.
+ * Sleeping is only done in thread mode with interrupts enabled, and on the
+ * core that owns the timer. Otherwise (or if no alarm is free), this falls
+ * back to polling like delay_us(). Other interrupts still run while
+ * sleeping.
+ *
+ * On the host, clock_nanosleep() is used.
+ *
+ * @param us            amount of microseconds to block
+ */
+void delay_us_sleep(uint64_t microseconds);
+
 /* Set a non-blocking timeout.
  * This offers more flexibility than delay_us.
  *
@@ -112,6 +203,20 @@ void delay_timeout_set(delay_timeout_t *timeout, uint64_t microseconds);
  */
 bool delay_timeout_done(delay_timeout_t *timeout);
 
+/* Variants of delay_timeout_set() and delay_timeout_done() with an explicit
+ * timestamp.
+ *
+ * Reading the timer is the main cost of these functions. When many timeouts
+ * (or other objects with an _at() variant, like rate limiters and profiles)
+ * are handled in a loop, take one timestamp per iteration with
+ * delay_get_timestamp() and pass it to all of them.
+ *
+ * @param now           timestamp from delay_get_timestamp()
+ */
+void delay_timeout_set_at(delay_timeout_t *timeout, uint64_t now,
+        uint64_t microseconds);
+bool delay_timeout_done_at(delay_timeout_t *timeout, uint64_t now);
+
 
 /* Delay using a loop (deprecated).
  * Not very precise, but does not depend on timers.
@@ -0,0 +1,119 @@
+#ifndef DELAY_TIMER_H
+#define DELAY_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "delay.h"
+
+// Max amount of callbacks that can be scheduled at the same time (max 255)
+#if (!defined(DELAY_TIMER_MAX_SCHEDULED))
+    #define DELAY_TIMER_MAX_SCHEDULED (8)
+#endif
+
+typedef void (*DelayTimerCB)(void *ctx);
+
+typedef struct {
+    uint32_t wakeups;       // timer interrupts that called a callback
+    uint32_t callbacks;     // callbacks called from those interrupts
+} DelayTimerStats;
+
+// One-shot timers need the timer interrupt, so only the core that
+// owns the delay timer can use them.
+#if (DELAY_OWNER)
+
+/**
+ * Reset the timer queue: all scheduled callbacks are dropped.
+ *
+ * This is called by delay_init() before the timer interrupt is enabled,
+ * there is normally no need to call it.
+ */
+void delay_timer_init(void);
+
+/**
+ * Schedule a one-shot callback.
+ *
+ * Instead of polling a delay_timeout_t, the callback is called from the
+ * delay timer interrupt as soon as the deadline is reached.
+ * The timer hardware is programmed for the earliest deadline only, so there is
+ * no periodic interrupt load while waiting.
+ *
+ * NOTE: the callback runs in interrupt context!
+ *
+ * @param deadline      Timestamp (see delay_get_timestamp()) at which the
+ *                      callback should be called. Use delay_timeout_set()
+ *                      to calculate a deadline from a time in microseconds.
+ *                      If the deadline has already passed, the callback
+ *                      is called as soon as possible.
+ * @param cb            Callback to call when the deadline is reached
+ * @param ctx           Argument for the callback
+ *
+ * @return              A handle (>= 0) that can be used to cancel the
+ *                      callback, or -1 if too many callbacks are scheduled.
+ */
+int delay_timer_schedule(uint64_t deadline, DelayTimerCB cb, void *ctx);
+
+/**
+ * Schedule a one-shot callback that may run up to 'slack_us' microseconds
+ * late (like the Linux timer slack).
+ *
+ * The timer interrupt is programmed for the earliest 'deadline + slack' of
+ * all scheduled callbacks, and then calls every callback whose deadline has
+ * passed. Callbacks with overlapping windows are handled with a single
+ * wake-up instead of one each.
+ *
+ * Same as delay_timer_schedule() if 'slack_us' is 0.
+ */
+int delay_timer_schedule_slack(uint64_t deadline, uint64_t slack_us,
+        DelayTimerCB cb, void *ctx);
+
+/**
+ * Cancel a scheduled callback.
+ *
+ * @param handle    Handle returned by delay_timer_schedule()
+ *
+ * @return          True if the callback was cancelled, false if it was not
+ *                  scheduled (anymore), e.g. because it already ran.
+ */
+bool delay_timer_cancel(int handle);
+
+/**
+ * Get the amount of callbacks that are currently scheduled.
+ */
+int delay_timer_count_scheduled(void);
+
+/**
+ * Get the amount of wake-ups (timer interrupts that called at least one
+ * callback) and callbacks since delay_timer_init(), e.g. to measure the effect
+ * of slack. Interrupts for other timer events (overflow, the coarse
+ * timestamp, ...) are not counted. The counters wrap.
+ */
+void delay_timer_get_stats(DelayTimerStats *stats);
+
+/**
+ * Call all callbacks that are due and re-program the timer.
+ *
+ * This is called by the delay timer interrupt handler.
+ */
+void delay_timer_irq_handler(void);
+
+
+/*
+ * Platform interface: these are implemented by the delay timer backend.
+ */
+
+// Make sure delay_timer_irq_handler() gets called as soon as possible when
+// 'deadline' is reached, or immediately if it has already passed.
+// This replaces any earlier deadline.
+void delay_timer_platform_arm(uint64_t deadline);
+
+// Stop calling delay_timer_irq_handler(): nothing is scheduled
+void delay_timer_platform_disarm(void);
+
+// Prevent delay_timer_irq_handler() from running (lock) or allow it to run
+// again (unlock). These calls are not nested.
+void delay_timer_platform_lock(void);
+void delay_timer_platform_unlock(void);
+
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef GCRA_LIMITER_H
+#define GCRA_LIMITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "token_bucket_limiter.h"
+
+/**
+ * Rate limiter based on the Generic Cell Rate Algorithm (GCRA).
+ *
+ * This limits events like a token bucket with the same TokenBucketPolicy,
+ * but the only state is one timestamp: the 'theoretical arrival time' (TAT)
+ * of the next event. Tokens refill continuously, one every
+ * interval_us / num_req_per_interval microseconds.
+ *
+ * When an event is not allowed, the limiter tells exactly how long to wait,
+ * so the caller can sleep or set a delay_timeout_t instead of polling.
+ *
+ * The TAT is kept in units of 1/num_req_per_interval microseconds: the
+ * uptime in microseconds times num_req_per_interval should fit in 64 bits
+ * (e.g. 570 years at 1000 requests per interval).
+ */
+typedef struct {
+    const TokenBucketPolicy *policy;
+    uint64_t tat;
+} GcraLimiter;
+
+/**
+ * Initialize a GCRA limiter. Initially, the bucket is full.
+ *
+ * @param limiter   Limiter to initialize
+ * @param policy    Rate limit settings, see token_bucket_policy_init().
+ *                  This is not copied: it should stay valid while the limiter
+ *                  is used, and can be shared by many limiters.
+ */
+void gcra_limiter_init(GcraLimiter *limiter, const TokenBucketPolicy *policy);
+
+/**
+ * Check if a specified amount of events is allowed (all or nothing).
+ *
+ * @param limiter       Limiter, see gcra_limiter_init()
+ * @param num_events    Amount of events to 'claim'
+ * @param wait_us       If not NULL, this is set to the time in microseconds
+ *                      until the events would be allowed: 0 if they are
+ *                      allowed now, UINT64_MAX if they never will be
+ *                      (more events than max_tokens).
+ *
+ * @return              True if the events are allowed (and claimed)
+ */
+bool gcra_limiter_allowed(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t *wait_us);
+
+/**
+ * Get the time in microseconds until 'num_events' would be allowed,
+ * without claiming anything (see gcra_limiter_allowed()).
+ */
+uint64_t gcra_limiter_wait_us(GcraLimiter *limiter, unsigned int num_events);
+
+/**
+ * Check how many events would be allowed at this moment
+ */
+unsigned int gcra_limiter_count_available(GcraLimiter *limiter);
+
+/**
+ * Variants with an explicit timestamp 'now' from delay_get_timestamp()
+ * (see token_bucket_limiter_allowed_at())
+ */
+bool gcra_limiter_allowed_at(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t *wait_us, uint64_t now);
+uint64_t gcra_limiter_wait_us_at(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t now);
+unsigned int gcra_limiter_count_available_at(GcraLimiter *limiter,
+        uint64_t now);
+
+#endif
@@ -3,23 +3,117 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "timer_wheel.h"
+#include "deadline_heap.h"
 
-#define MAX_INTERVALS 5
+// Max amount of intervals per IntervalList. Override this in CMake
+// if more periodic jobs are needed (each costs one Interval and one wheel entry)
+#if (!defined(MAX_INTERVALS))
+    #define MAX_INTERVALS 5
+#endif
+
+// Max amount of phase offsets that are tried per interval to find the one
+// with the least collisions (see interval_set_stagger())
+#if (!defined(INTERVAL_STAGGER_CANDIDATES))
+    #define INTERVAL_STAGGER_CANDIDATES 64
+#endif
+
+// Optional parts of an IntervalList. Each costs RAM in every IntervalList,
+// so only the wheel is enabled by default:
+//  INTERVAL_WHEEL      Schedule intervals on a timing wheel, so the cost of
+//                      interval_irq_handler() does not grow with the amount
+//                      of intervals. Costs a TimerWheel (see
+//                      TIMER_WHEEL_SLOT_BITS) plus 12 bytes per interval.
+//                      If disabled, the irq handler checks every interval.
+//  INTERVAL_TICKLESS   Tickless mode (see interval_init_tickless()). Costs a
+//                      deadline heap of about 18 bytes per interval.
+//  INTERVAL_QUEUE      Call the callbacks in order of their due time and keep
+//                      latency statistics. Costs 8 bytes per interval plus a
+//                      queue of 16 bytes per interval. If disabled, callbacks
+//                      are called in the order in which they were added.
+#if (!defined(INTERVAL_WHEEL))
+    #define INTERVAL_WHEEL (1)
+#endif
+#if (!defined(INTERVAL_TICKLESS))
+    #define INTERVAL_TICKLESS (0)
+#endif
+#if (!defined(INTERVAL_QUEUE))
+    #define INTERVAL_QUEUE (0)
+#endif
 
 typedef void (*IntervalCB)(void);
 
+/*
+ * 'reached' is set while a callback is queued for interval_poll().
+ *
+ * Statistics, in the time unit of the list (microseconds in tickless mode):
+ *  missed          Periods that were dropped: the callback was still queued
+ *                  from an earlier period, or (tickless) the update was more
+ *                  than a whole period late.
+ *  last_latency,   Time between the due time of a callback and the moment
+ *  max_latency     interval_poll() called it. In tick mode, a callback is
+ *                  'due' at the tick that reached it. Only with
+ *                  INTERVAL_QUEUE.
+ */
 typedef struct {
     uint32_t time;
+    uint32_t offset;    // phase, in the same unit as 'time'
     IntervalCB cb;
     volatile bool reached;
+
+    volatile uint32_t missed;
+#if (INTERVAL_QUEUE)
+    uint32_t last_latency;
+    uint32_t max_latency;
+#endif
 } Interval;
 
+#if (INTERVAL_QUEUE)
+// A callback that is due, passed from the irq handler to interval_poll()
+typedef struct {
+    uint64_t due;   // tick counter, or timestamp in tickless mode
+    uint16_t index;
+} IntervalEvent;
+
+// Each interval has at most one event queued, plus one that interval_poll()
+// is taking out of the queue
+#define INTERVAL_QUEUE_SLOTS (MAX_INTERVALS + 2)
+#endif
+
 typedef struct {
     Interval intervals[MAX_INTERVALS];
     volatile int num_intervals;
     volatile uint32_t last_time;
     volatile uint32_t counter;
     volatile bool poll_required;
+    bool stagger;
+
+#if (INTERVAL_QUEUE)
+    // Single-producer (irq handler), single-consumer (poll) queue of
+    // callbacks in order of their due time
+    IntervalEvent queue[INTERVAL_QUEUE_SLOTS];
+    volatile uint32_t queue_head;
+    volatile uint32_t queue_tail;
+#endif
+
+    // Intervals that were picked up by the irq handler (or interval_update()):
+    // num_scheduled trails num_intervals until then.
+    int num_scheduled;
+
+#if (INTERVAL_WHEEL)
+    // Only the irq handler touches the wheel
+    TimerWheel wheel;
+    TimerWheelEntry wheel_entries[MAX_INTERVALS];
+#endif
+
+#if (INTERVAL_TICKLESS)
+    // Tickless mode (see interval_init_tickless()): the next due timestamp
+    // of each scheduled interval is kept in a heap instead of the wheel.
+    bool tickless;
+    DeadlineHeap heap;
+    DeadlineHeapNode heap_nodes[MAX_INTERVALS];
+    uint16_t heap_positions[MAX_INTERVALS];
+#endif
 } IntervalList;
 
 /**
@@ -27,22 +121,73 @@ typedef struct {
  */
 void interval_init(IntervalList *interval_list);
 
+#if (INTERVAL_TICKLESS)
+/**
+ * Initialize a IntervalList in tickless mode.
+ *
+ * In this mode, the interval times passed to interval_add() are in
+ * microseconds, and intervals are timed with delay_get_timestamp():
+ * instead of interval_irq_handler() on a periodic tick, call interval_update()
+ * whenever the system wakes up. interval_next_deadline() tells when the next
+ * callback is due, so the system can sleep until exactly then (e.g. with a
+ * delay_timer_schedule() alarm).
+ *
+ * The first callback of an interval is due one interval (plus its offset,
+ * see interval_set_stagger()) after the interval_update() call that picks
+ * it up. Later callbacks keep the same phase:
+ * if an update is late, the next callback is not postponed. If one or more
+ * whole intervals were missed, the callback is only queued once (the rest is
+ * counted in Interval.missed).
+ *
+ * Only with INTERVAL_TICKLESS.
+ */
+void interval_init_tickless(IntervalList *interval_list);
+#endif
+
+/**
+ * Spread the intervals that are added from now on over time, instead of
+ * letting all of them fire on the same tick (e.g. at multiples of the least
+ * common multiple of their times). Disabled by default.
+ *
+ * Each interval gets a phase offset when it is added:
+ *  - In tick mode, the callback is due when the tick counter modulo 'time'
+ *    equals the offset. Two intervals collide on the ticks where their
+ *    offsets are equal modulo the gcd of their times, so the offset with the
+ *    least (weighted by how often) collisions with the existing intervals is
+ *    used. At most INTERVAL_STAGGER_CANDIDATES offsets are tried.
+ *  - In tickless mode, the first callback is delayed by a fraction of the
+ *    interval time. The fractions follow a golden ratio sequence, so any
+ *    amount of intervals is spread evenly.
+ */
+void interval_set_stagger(IntervalList *interval_list, bool enable);
+
 /**
  * Add an interval to the intervallist
  *
  * time: the interval time in a arbitrary time unit. Make sure the same unit is 
- * used in interval_irq_handler.
- * cb: a callback function that needs to get called every time the interval 
+ * used in interval_irq_handler. The callback is due every time the tick
+ * counter is a multiple of 'time', so it should be at least 1.
+ * cb: a callback function that needs to get called every time the interval
  * has passed.
  */
 bool interval_add(IntervalList *interval_list, uint32_t time, IntervalCB cb);
 
 /**
  * Call this function in your main loop.
- * This will call all callbacks that are due.
+ * This will call all callbacks that are due. With INTERVAL_QUEUE, they are
+ * called in order of their due time, and the latency statistics of their
+ * intervals are updated.
  */
 void interval_poll(IntervalList *interval_list);
 
+/**
+ * Same as interval_poll(), but stop calling callbacks once 'budget_us'
+ * microseconds (measured with delay_get_timestamp()) have passed. At least
+ * one callback is called per call. The remaining callbacks stay queued:
+ * interval_is_poll_required() stays true.
+ */
+void interval_poll_budget(IntervalList *interval_list, uint32_t budget_us);
+
 /**
  * Optionally call this function to determine if interval_poll()
  * needs to be called. This could be done from interrupt context or in other
@@ -59,4 +204,31 @@ bool interval_is_poll_required(IntervalList *interval_list);
  */
 void interval_irq_handler(IntervalList *interval_list, uint32_t time);
 
+#if (INTERVAL_TICKLESS)
+/**
+ * Tickless mode: mark the intervals that are due as reached
+ * (call interval_poll() to run their callbacks) and schedule their next
+ * due time. Call this after waking up at interval_next_deadline(), from the
+ * same context as interval_next_deadline().
+ */
+void interval_update(IntervalList *interval_list);
+
+/**
+ * Same as interval_update(), for a timestamp 'now' from delay_get_timestamp()
+ */
+void interval_update_at(IntervalList *interval_list, uint64_t now);
+
+/**
+ * Tickless mode: get the timestamp (see delay_get_timestamp()) at which
+ * interval_update() should be called next.
+ *
+ * If intervals were added that are not scheduled yet, this is 0: call
+ * interval_update() right away.
+ *
+ * @return  False if there are no intervals (nothing to wake up for)
+ */
+bool interval_next_deadline(IntervalList *interval_list, uint64_t *deadline);
+
+#endif
+
 #endif
@@ -2,17 +2,91 @@
 #define PROFILE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "profile_trace.h"
 
-#define MAX_PROFILES 100
+/*
+ * Profiles are registered at link time: PROFILE and PROFILE_DEFINE() place a
+ * statically initialized Profile in the linker section PROFILE_SECTION.
+ * The linker collects all of them into one array, which is enumerated by
+ * profile_get_data(). There is no limit on the amount of profiles.
+ *
+ * With GNU ld (and the host build on ELF platforms), the section is placed
+ * automatically and __start_/__stop_ symbols are generated for it.
+ * A custom MCU linker script should place it in RAM with initial values
+ * (next to .data, so the startup code copies it) and keep it:
+ *
+ *      . = ALIGN(8);
+ *      __start_mcu_timing_profiles = .;
+ *      KEEP(*(mcu_timing_profiles))
+ *      __stop_mcu_timing_profiles = .;
+ *
+ * Profiles initialized at runtime with profile_init() work as before, but are
+ * not part of the list.
+ */
+#if (!defined(PROFILE_SECTION))
+    #define PROFILE_SECTION mcu_timing_profiles
+#endif
+
+// Optional latency histogram per profile: define PROFILE_HISTOGRAM=1.
+//
+// The histogram is log-linear (HDR-style): each power-of-two range of ticks is
+// split into 2^PROFILE_HISTOGRAM_SUB_BITS buckets, so a percentile is reported
+// with a relative error of at most 2^-PROFILE_HISTOGRAM_SUB_BITS.
+// Durations of 2^PROFILE_HISTOGRAM_MAX_BITS ticks or more end up in the last
+// bucket. Memory cost per profile is 4 * PROFILE_HISTOGRAM_BUCKETS bytes
+// (368 bytes with the defaults).
+#if (!defined(PROFILE_HISTOGRAM))
+    #define PROFILE_HISTOGRAM (0)
+#endif
+#if (!defined(PROFILE_HISTOGRAM_SUB_BITS))
+    #define PROFILE_HISTOGRAM_SUB_BITS (2)
+#endif
+#if (!defined(PROFILE_HISTOGRAM_MAX_BITS))
+    #define PROFILE_HISTOGRAM_MAX_BITS (24)
+#endif
 
+#if (PROFILE_HISTOGRAM_MAX_BITS > 31)
+    #error PROFILE_HISTOGRAM_MAX_BITS should be 31 or less
+#endif
+
+// Max sample rate for profile_set_sampling()
+#define PROFILE_MAX_SAMPLE_RATE (32768)
+
+// Amount of empty start/end pairs measured by profile_calibrate()
+#if (!defined(PROFILE_CALIBRATION_RUNS))
+    #define PROFILE_CALIBRATION_RUNS (16)
+#endif
+
+#define PROFILE_HISTOGRAM_BUCKETS \
+    (((PROFILE_HISTOGRAM_MAX_BITS - PROFILE_HISTOGRAM_SUB_BITS) + 1) \
+     << PROFILE_HISTOGRAM_SUB_BITS)
+
+/*
+ * With sampling enabled (see profile_set_sampling()), only some calls are
+ * timed: call_count counts every call, sample_count only the timed calls.
+ * ticks, max_ticks, threshold_call_count and the histogram only include
+ * the timed calls.
+ *
+ * Durations (and the threshold) are in delay_get_timestamp() ticks: convert
+ * them with delay_ticks_to_ns(). For sub-microsecond resolution, build with
+ * DELAY_TIMER_FULL_RATE.
+ */
 typedef struct {
     uint64_t call_count;
+    uint64_t sample_count;
     uint64_t threshold_call_count;
     uint64_t ticks;
     uint64_t max_ticks;
     uint64_t threshold;
     uint64_t timestamp;
     const char *label;
+    uint16_t sample_rate;
+    uint16_t sample_countdown;
+    bool sample_random;
+#if (PROFILE_HISTOGRAM)
+    uint32_t histogram[PROFILE_HISTOGRAM_BUCKETS];
+#endif
 } Profile;
 
 void profile_init(Profile *prof, const char *label, uint64_t threshold);
@@ -20,37 +94,143 @@ void profile_reset(Profile *prof);
 void profile_start(Profile *prof);
 void profile_end(Profile *prof);
 void profile_end_ptr(Profile **prof);
+
+/*
+ * Variants with an explicit timestamp from delay_get_timestamp(), to share
+ * one timer read between several profiles (e.g. the end of one phase of a
+ * loop is the start of the next one). Note that calibration assumes
+ * profile_start() and profile_end(): disable compensation when the
+ * timestamps are taken elsewhere.
+ */
+void profile_start_at(Profile *prof, uint64_t now);
+void profile_end_at(Profile *prof, uint64_t now);
+
+/*
+ * Time only one in 'rate' calls (0 or 1: time every call).
+ *
+ * Every call is still counted, but skipped calls cost only a counter update
+ * instead of two timestamps. profile_get_average(), the histogram percentiles
+ * and profile_get_threshold_count() are extrapolated from the timed calls.
+ *
+ * If 'random' is set, the amount of calls between samples is random (uniform
+ * in 1..2*rate-1, a cheap LFSR is used), so calls that happen in a fixed
+ * pattern are not systematically skipped. Otherwise, every rate-th call is
+ * timed. The rate is limited to PROFILE_MAX_SAMPLE_RATE.
+ *
+ * Note that with PROFILE_TRACE or PROFILE_CALLTREE, only timed calls are
+ * recorded: avoid sampling profiles that contain other profiles.
+ */
+void profile_set_sampling(Profile *prof, uint16_t rate, bool random);
+
+/*
+ * Average duration of the timed calls
+ */
 uint64_t profile_get_average(Profile *prof);
 uint64_t profile_get_total_call_count(Profile *prof);
 uint64_t profile_get_max(Profile *prof);
+
+/*
+ * Amount of calls that took longer than the threshold. With sampling, this
+ * is extrapolated to all calls.
+ */
 uint64_t profile_get_threshold_count(Profile *prof);
+
+/*
+ * Measure the overhead of the profiler itself and enable compensation.
+ *
+ * A measured duration includes part of profile_start() and profile_end(),
+ * most notably reading the timestamp. This measures an empty start/end pair
+ * PROFILE_CALIBRATION_RUNS times and keeps the fastest run (slower runs were
+ * interrupted). From then on, profile_end() subtracts that overhead from every
+ * duration (saturating at 0) before updating the totals, the max, the
+ * threshold count and the histogram.
+ *
+ * Call this once at init, after delay_init(). With PROFILE_TRACE enabled, the
+ * calibration runs show up in the trace as unknown profiles. With
+ * PROFILE_CALLTREE enabled, the call tree is reset.
+ *
+ * Returns the measured overhead in ticks.
+ */
+uint64_t profile_calibrate(void);
+
+/*
+ * Enable or disable overhead compensation (enabled by profile_calibrate()).
+ */
+void profile_set_compensation(bool enable);
+
+/*
+ * Get the overhead in ticks measured by profile_calibrate(),
+ * or 0 if it was not called. This does not depend on profile_set_compensation()
+ */
+uint64_t profile_get_overhead(void);
+
+/*
+ * Get the amount of profiles defined with PROFILE / PROFILE_DEFINE()
+ */
 int profile_list_size(void);
 
+#if (PROFILE_HISTOGRAM)
+/*
+ * Get a percentile of the duration in ticks (requires PROFILE_HISTOGRAM)
+ *
+ * permille = percentile * 10: use 500 for the median (p50),
+ * 990 for p99 or 999 for p99.9.
+ *
+ * Returns the upper bound of the histogram bucket the percentile falls in
+ * (but never more than the maximum duration), or 0 if nothing was measured.
+ */
+uint64_t profile_get_percentile(Profile *prof, unsigned int permille);
+#endif
+
 /*
  * Get the list of all profiles and the number of profiles in that list
- * list = pointer to array of Profile pointers
+ * list = set to the first element of an array of Profiles
  * Returns profile_list_size
  */
-int profile_get_data(Profile **list[MAX_PROFILES]);
+int profile_get_data(Profile **list);
+
+/*
+ * Get the position of a profile in the list, or -1 if it is not listed
+ */
+int profile_get_index(const Profile *prof);
+
+#define PROFILE_STR_(x) #x
+#define PROFILE_STR(x) PROFILE_STR_(x)
+
+// The alignment is fixed so the linker packs the profiles as an array
+#define PROFILE_ATTRIBUTES \
+    __attribute__ ((section(PROFILE_STR(PROFILE_SECTION)), used, aligned(8)))
+
+/*
+ * Define a listed profile, e.g. at file scope:
+ *      static PROFILE_DEFINE(rx_prof, "uart rx", 100);
+ */
+#define PROFILE_DEFINE(name, label_, threshold_) \
+    PROFILE_DEFINE_SAMPLED(name, label_, threshold_, 0, false)
+
+/*
+ * Define a listed profile that times one in 'rate' calls,
+ * see profile_set_sampling()
+ */
+#define PROFILE_DEFINE_SAMPLED(name, label_, threshold_, rate, random) \
+    Profile name PROFILE_ATTRIBUTES = { \
+        .threshold = (threshold_), \
+        .label = (label_), \
+        .sample_rate = (rate), \
+        .sample_random = (random) \
+    }
 
 #if PROFILE_ENABLED == 1
-#define PROFILE \
-    static Profile prof = { \
-        .call_count = 0, \
-        .threshold_call_count = 0, \
-        .ticks = 0, \
-        .max_ticks = 0, \
-        .threshold = 0, \
-        .timestamp = 0, \
-        .label = 0 \
-    }; \
+#define PROFILE PROFILE_SAMPLED(0)
+
+// Like PROFILE, but only time one in 'rate' calls (for very hot functions)
+#define PROFILE_SAMPLED(rate) \
+    static PROFILE_DEFINE_SAMPLED(prof, __func__, 0, (rate), false); \
     Profile *prof_ptr __attribute__ ((__cleanup__(profile_end_ptr))) = &prof; \
-    if (!prof.label) { \
-        profile_init(&prof, __func__, 0); \
-    } \
     profile_start(&prof);
 #else
 #define PROFILE
+#define PROFILE_SAMPLED(rate)
 #endif
 
 #endif
@@ -0,0 +1,110 @@
+#ifndef PROFILE_CALLTREE_H
+#define PROFILE_CALLTREE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "profile.h"
+#include "profile_trace.h"
+
+// Opt-in call tree of nested profiles: define PROFILE_CALLTREE=1.
+//
+// profile_start() / profile_end() maintain a shadow stack of active profiles,
+// so nested profiles are attributed to their parent: each node of the tree
+// is a call path (e.g. main_loop -> handle_rx -> parse) with its own call
+// count, inclusive time and exclusive (self) time.
+#if (!defined(PROFILE_CALLTREE))
+    #define PROFILE_CALLTREE (0)
+#endif
+
+// Max amount of call paths per context. Further paths are counted as dropped.
+// Memory cost is 32 bytes per node per context.
+#if (!defined(PROFILE_CALLTREE_NODES))
+    #define PROFILE_CALLTREE_NODES (32)
+#endif
+
+// Max nesting depth per context. Deeper profiles are not attributed.
+#if (!defined(PROFILE_CALLTREE_DEPTH))
+    #define PROFILE_CALLTREE_DEPTH (16)
+#endif
+
+#if (PROFILE_CALLTREE_NODES >= 0xFFFE)
+    #error PROFILE_CALLTREE_NODES should be less than 0xFFFE
+#endif
+
+/*
+ * Each execution context has its own stack and tree, so interrupts do not
+ * show up as children of whatever code they happened to interrupt:
+ *
+ *  PROFILE_CALLTREE_THREAD     Thread mode (the main loop). On the host,
+ *                              everything runs in this context.
+ *  PROFILE_CALLTREE_HANDLER    Handler mode (any interrupt, on Cortex-M).
+ *                              Nested interrupts appear as children of the
+ *                              interrupt they preempted.
+ *
+ * Nested interrupts share the handler context: to keep it consistent,
+ * interrupts are masked for the short stack / counter update in
+ * profile_start() and profile_end().
+ */
+#define PROFILE_CALLTREE_THREAD     (0)
+#define PROFILE_CALLTREE_HANDLER    (1)
+#define PROFILE_CALLTREE_CONTEXTS   (2)
+
+// Parent of a top-level node
+#define PROFILE_CALLTREE_ROOT       (0xFFFF)
+
+typedef struct {
+    const Profile *prof;
+    uint16_t parent;            // node index or PROFILE_CALLTREE_ROOT
+    uint16_t next;              // used internally for lookup
+    uint32_t call_count;
+    uint64_t inclusive_ticks;   // time spent in this path, including children
+    uint64_t self_ticks;        // time spent in this path, excluding children
+} ProfileCallTreeNode;
+
+#if (PROFILE_CALLTREE)
+
+/*
+ * Push / pop a profile on the shadow stack of the current context.
+ *
+ * These are called by profile_start() and profile_end(). A profile that ends
+ * while profiles started after it are still active (e.g. a missing
+ * profile_end()) closes those as well.
+ */
+void profile_calltree_enter(const Profile *prof);
+void profile_calltree_exit(const Profile *prof, uint64_t ticks);
+
+/*
+ * Discard all nodes and active stacks.
+ *
+ * Call this from the main loop. Profiles that are active at that moment are
+ * not recorded.
+ */
+void profile_calltree_reset(void);
+
+/*
+ * Get the nodes of a context (PROFILE_CALLTREE_THREAD or _HANDLER).
+ * nodes = set to the first element of the node array
+ * Returns the amount of nodes
+ */
+int profile_calltree_get_nodes(int context, const ProfileCallTreeNode **nodes);
+
+/*
+ * Get the amount of profile calls that were not attributed, because the
+ * node table was full or the stack was too deep.
+ */
+uint32_t profile_calltree_get_dropped(void);
+
+/*
+ * Write the call tree as folded stacks, one line per node:
+ *
+ *      main_loop;handle_rx;parse 1234
+ *
+ * where the number is the self time in ticks. Paths of the handler context
+ * start with 'irq'. The output can be fed directly to flamegraph.pl,
+ * speedscope or inferno.
+ */
+void profile_calltree_dump_folded(ProfileSink sink, void *ctx);
+
+#endif
+
+#endif
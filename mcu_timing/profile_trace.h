@@ -0,0 +1,104 @@
+#ifndef PROFILE_TRACE_H
+#define PROFILE_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Opt-in event trace of profile_start() / profile_end(): define PROFILE_TRACE=1.
+// The trace is a flight recorder: when full, the oldest events are overwritten.
+#if (!defined(PROFILE_TRACE))
+    #define PROFILE_TRACE (0)
+#endif
+
+// Amount of 32-bit records in the trace buffer (power of two)
+#if (!defined(PROFILE_TRACE_SIZE))
+    #define PROFILE_TRACE_SIZE (256)
+#endif
+
+#if (PROFILE_TRACE_SIZE & (PROFILE_TRACE_SIZE - 1))
+    #error PROFILE_TRACE_SIZE should be a power of two
+#endif
+
+/*
+ * Record format (one 32-bit word per event):
+ *
+ *  bits 31..22     profile index (PROFILE_TRACE_SYNC for a sync record,
+ *                  PROFILE_TRACE_UNKNOWN for profiles that are not listed,
+ *                  see profile_get_index())
+ *  bit  21         0 = start, 1 = end
+ *  bits 20..0      lowest 21 bits of the timestamp
+ *
+ * Timestamps are delta-encoded: the decoder recovers the (signed) delta to
+ * the previous record from the low bits. A sync record holds timestamp
+ * bits 42..21 (in bits 21..0) of the event record directly after it.
+ * Sync records are inserted regularly and after long gaps, so a decoder
+ * can start at any sync record.
+ */
+#define PROFILE_TRACE_INDEX_SHIFT   (22)
+#define PROFILE_TRACE_END_BIT       (1UL << 21)
+#define PROFILE_TRACE_TIME_BITS     (21)
+#define PROFILE_TRACE_SYNC          (0x3FF)
+#define PROFILE_TRACE_UNKNOWN       (0x3FE)
+
+#define PROFILE_TRACE_MAGIC         (0x43525450) // "PTRC"
+#define PROFILE_TRACE_VERSION       (1)
+
+/*
+ * Dump layout (little endian):
+ *  ProfileTraceHeader
+ *  num_records x uint32_t record, oldest first
+ *  num_labels x (uint16_t length, label characters without terminator),
+ *      the label of profile index i is the i-th label
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t ticks_per_second;
+    uint32_t num_records;
+    uint32_t num_labels;
+} ProfileTraceHeader;
+
+/**
+ * Byte sink to write a trace dump to (UART, USB, file, ...)
+ *
+ * The data pointer may point directly into the trace buffer: the sink
+ * should process or copy the data before returning.
+ */
+typedef void (*ProfileSink)(void *ctx, const void *data, uint32_t size);
+
+#if (PROFILE_TRACE)
+
+/**
+ * Record a start or end event.
+ *
+ * This is called by profile_start() and profile_end() and is safe to call
+ * from interrupts: space in the buffer is reserved with an atomic add.
+ */
+void profile_trace_event(uint16_t index, bool end, uint64_t timestamp);
+
+/**
+ * Pause or resume recording (recording is enabled by default).
+ *
+ * Pause recording before a dump to get a consistent snapshot.
+ */
+void profile_trace_enable(bool enable);
+
+/**
+ * Discard all recorded events.
+ */
+void profile_trace_clear(void);
+
+/**
+ * Write the trace to a byte sink.
+ *
+ * The records are passed to the sink straight from the trace buffer
+ * (at most two chunks), without copying.
+ * Use tools/profile_trace_to_json.py to convert a dump to Chrome trace /
+ * Perfetto JSON.
+ */
+void profile_trace_dump(ProfileSink sink, void *ctx);
+
+#endif
+
+#endif
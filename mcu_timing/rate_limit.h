@@ -36,5 +36,9 @@ void rate_limit_init(RateLimit *limit, uint64_t min_delay, uint64_t max_delay,
 // return true if current request is allowed
 bool rate_limit_allowed(RateLimit *limit);
 
+// same as rate_limit_allowed(), for a timestamp from delay_get_timestamp()
+// that is shared with other _at() calls (see delay_timeout_set_at())
+bool rate_limit_allowed_at(RateLimit *limit, uint64_t now);
+
 #endif
 
@@ -0,0 +1,171 @@
+#include "deadline_heap.h"
+
+static void place(DeadlineHeap *heap, uint16_t pos, DeadlineHeapNode node)
+{
+    heap->nodes[pos] = node;
+    heap->positions[node.id] = pos;
+}
+
+static void sift_up(DeadlineHeap *heap, uint16_t pos)
+{
+    const DeadlineHeapNode node = heap->nodes[pos];
+
+    while(pos) {
+        const uint16_t parent = (pos - 1) / 2;
+        if(heap->nodes[parent].deadline <= node.deadline) {
+            break;
+        }
+        place(heap, pos, heap->nodes[parent]);
+        pos = parent;
+    }
+    place(heap, pos, node);
+}
+
+static void sift_down(DeadlineHeap *heap, uint16_t pos)
+{
+    const DeadlineHeapNode node = heap->nodes[pos];
+
+    while(1) {
+        uint32_t child = (2 * (uint32_t)pos) + 1;
+        if(child >= heap->size) {
+            break;
+        }
+        if(((child + 1) < heap->size)
+                && (heap->nodes[child + 1].deadline < heap->nodes[child].deadline)) {
+            child++;
+        }
+        if(node.deadline <= heap->nodes[child].deadline) {
+            break;
+        }
+        place(heap, pos, heap->nodes[child]);
+        pos = child;
+    }
+    place(heap, pos, node);
+}
+
+void deadline_heap_init(DeadlineHeap *heap, DeadlineHeapNode *nodes,
+        uint16_t *positions, uint16_t capacity)
+{
+    heap->nodes = nodes;
+    heap->positions = positions;
+    heap->capacity = capacity;
+    heap->size = 0;
+
+    for(int i=0; i < capacity; i++) {
+        positions[i] = DEADLINE_HEAP_NONE;
+    }
+}
+
+bool deadline_heap_contains(const DeadlineHeap *heap, uint16_t id)
+{
+    return (id < heap->capacity)
+        && (heap->positions[id] != DEADLINE_HEAP_NONE);
+}
+
+bool deadline_heap_set(DeadlineHeap *heap, uint16_t id, uint64_t deadline)
+{
+    if(id >= heap->capacity) {
+        return false;
+    }
+
+    const DeadlineHeapNode node = {.deadline = deadline, .id = id};
+    uint16_t pos = heap->positions[id];
+
+    if(pos == DEADLINE_HEAP_NONE) {
+        pos = heap->size++;
+        place(heap, pos, node);
+        sift_up(heap, pos);
+        return true;
+    }
+
+    const uint64_t old_deadline = heap->nodes[pos].deadline;
+    heap->nodes[pos].deadline = deadline;
+    if(deadline < old_deadline) {
+        sift_up(heap, pos);
+    } else {
+        sift_down(heap, pos);
+    }
+    return true;
+}
+
+bool deadline_heap_remove(DeadlineHeap *heap, uint16_t id)
+{
+    if(!deadline_heap_contains(heap, id)) {
+        return false;
+    }
+
+    const uint16_t pos = heap->positions[id];
+    heap->positions[id] = DEADLINE_HEAP_NONE;
+    heap->size--;
+    if(pos == heap->size) {
+        return true;
+    }
+
+    // Move the last node into the gap and restore the heap property
+    const uint64_t removed_deadline = heap->nodes[pos].deadline;
+    place(heap, pos, heap->nodes[heap->size]);
+    if(heap->nodes[pos].deadline < removed_deadline) {
+        sift_up(heap, pos);
+    } else {
+        sift_down(heap, pos);
+    }
+    return true;
+}
+
+uint16_t deadline_heap_peek(const DeadlineHeap *heap, uint64_t *deadline)
+{
+    if(!heap->size) {
+        return DEADLINE_HEAP_NONE;
+    }
+    if(deadline) {
+        *deadline = heap->nodes[0].deadline;
+    }
+    return heap->nodes[0].id;
+}
+
+uint16_t deadline_heap_pop_expired(DeadlineHeap *heap, uint64_t now)
+{
+    uint64_t deadline;
+    const uint16_t id = deadline_heap_peek(heap, &deadline);
+
+    if((id == DEADLINE_HEAP_NONE) || (deadline > now)) {
+        return DEADLINE_HEAP_NONE;
+    }
+    deadline_heap_remove(heap, id);
+    return id;
+}
+
+// Recursion depth is the heap height: at most 16 levels
+static void find_latest(const DeadlineHeap *heap, const uint64_t *slack,
+        uint32_t pos, uint64_t *best)
+{
+    if(pos >= heap->size) {
+        return;
+    }
+    // The subtree has deadlines at or after this one: it can not improve
+    const DeadlineHeapNode *node = &heap->nodes[pos];
+    if(node->deadline >= *best) {
+        return;
+    }
+
+    const uint64_t s = slack[node->id];
+    const uint64_t latest = ((UINT64_MAX - node->deadline) < s)
+        ? UINT64_MAX : (node->deadline + s);
+    if(latest < *best) {
+        *best = latest;
+    }
+    find_latest(heap, slack, (2 * pos) + 1, best);
+    find_latest(heap, slack, (2 * pos) + 2, best);
+}
+
+bool deadline_heap_peek_latest(const DeadlineHeap *heap,
+        const uint64_t *slack, uint64_t *latest)
+{
+    if(!heap->size) {
+        return false;
+    }
+    uint64_t best = UINT64_MAX;
+    find_latest(heap, slack, 0, &best);
+    *latest = best;
+    return true;
+}
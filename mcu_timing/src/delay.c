@@ -1,11 +1,25 @@
 #include "delay.h"
-#include "chip.h"
-#include <lpc_tools/irq.h>
-#include <c_utils/assert.h>
+#include "delay_timer.h"
 #include <string.h>
 
+#if defined(MCU_PLATFORM_host)
+    #include <time.h>
+    #include <signal.h>
+    #include <sys/time.h>
+#else
+    #include "chip.h"
+    #include <lpc_tools/irq.h>
+    #include <c_utils/assert.h>
+#endif
+
 #define TIMER_HALFWAY      (0x80000000)
 
+// Match channel used to trigger delay_timer callbacks
+#define TIMER_ALARM_MATCH  (0)
+
+// Match channel used to update the coarse timestamp
+#define TIMER_COARSE_MATCH (3)
+
 //
 // Platform specific code
 //
@@ -79,6 +93,10 @@ static inline uint32_t get_timer_clock_rate(void)
 }
 #endif
 
+#elif defined(MCU_PLATFORM_host)
+    // Native build (Linux / macOS): no timer peripheral, see the host
+    // backend below.
+
 #else
     #error "the current platform is not supported yet"
     
@@ -92,12 +110,78 @@ static inline uint32_t get_timer_clock_rate(void)
     */
 #endif
 
+/**
+ * Fixed-point conversion: out = (in * mult) >> shift, optionally rounded up.
+ * See calc_conversion() and convert().
+ */
+typedef struct {
+    uint32_t mult;
+    uint32_t shift;
+    bool round_up;
+} Conversion;
+
+/**
+ * Tick rate and conversions, see delay_get_tick_rate(). Written by the
+ * owner in delay_init() / delay_reinit(), read by all cores.
+ */
+typedef struct {
+    uint32_t tick_rate;
+    Conversion ticks_to_ns;
+    Conversion ns_to_ticks;
+    Conversion ticks_to_us;
+    Conversion us_to_ticks;
+} TimeBase;
+
+static TimeBase g_timebase SECTION_STATEMENT;
+
+#if (DELAY_OWNER)
+// Conversion from a rate of 'from' Hz to 'to' Hz: mult = to * 2^shift / from
+// with 32 significant bits (relative error < 2^-31). It is calculated by long
+// division, one bit of the shift at a time, and rounded up so a whole number
+// of output units never converts to one less.
+static Conversion calc_conversion(uint32_t from, uint32_t to, bool round_up)
+{
+    uint64_t mult = to / from;
+    uint64_t remainder = to % from;
+    uint32_t shift = 0;
+    while(shift < 63) {
+        remainder<<= 1;
+        const uint64_t next = (mult << 1) | (remainder >= from);
+        if(next >= UINT32_MAX) {
+            remainder>>= 1;
+            break;
+        }
+        if(remainder >= from) {
+            remainder-= from;
+        }
+        mult = next;
+        shift++;
+    }
+    if(remainder) {
+        mult++;
+    }
+    return (Conversion){.mult = mult, .shift = shift, .round_up = round_up};
+}
+
+static void init_timebase(uint32_t tick_rate)
+{
+    g_timebase.tick_rate = tick_rate;
+    // Durations are rounded up to whole ticks: timeouts never end early
+    g_timebase.ticks_to_ns = calc_conversion(tick_rate, 1000000000, false);
+    g_timebase.ns_to_ticks = calc_conversion(1000000000, tick_rate, true);
+    g_timebase.ticks_to_us = calc_conversion(tick_rate, 1000000, false);
+    g_timebase.us_to_ticks = calc_conversion(1000000, tick_rate, true);
+}
+#endif
+
+#if (!defined(MCU_PLATFORM_host))
+
 /**
  * past_halfway     is a flag that is set whenever the timer value is known to
  * be above TIMER_HALFWAY. This is used to detect overflow: if the timer reads
  * as a small value while this flag is set, the timer has overflowed.
  * This allows the irqhandler to run on a different core and under any
- * priority level, as long as it is handled with latency << TIMER_HALFWAY microseconds
+ * priority level, as long as it is handled with latency << TIMER_HALFWAY ticks
  *
  * overflow_count   counts the amount of times the 32-bit timer has overflowed.
  * Together with the 32-bit timer value this forms a 64-bit timer.
@@ -121,10 +205,68 @@ static struct {
     TimeInfo time[2];
     volatile bool index;
 
+    // See delay_get_timestamp_coarse(). Only written by the owner.
+    volatile uint32_t coarse_ms;
+
 } g_state SECTION_STATEMENT;
 
+#if (DELAY_OWNER && DELAY_COARSE_PERIOD_MS)
+// Next period boundary of the coarse timestamp: ticks (modulo 2^32) plus a
+// fraction in 1/1000 ticks, and the same for the length of a period. A period
+// is not always a whole amount of ticks (e.g. at 1041666 Hz): the fraction is
+// carried over, so the match does not drift away from the time in ms.
+static uint32_t g_coarse_ticks;
+static uint32_t g_coarse_frac;
+static uint32_t g_coarse_period;
+static uint32_t g_coarse_period_frac;
+
+// The boundary rounded up to a whole tick: the coarse time is never ahead
+static inline uint32_t coarse_match(void)
+{
+    return g_coarse_ticks + (g_coarse_frac ? 1 : 0);
+}
+
+static void coarse_next_period(void)
+{
+    g_coarse_ticks+= g_coarse_period;
+    g_coarse_frac+= g_coarse_period_frac;
+    if(g_coarse_frac >= 1000) {
+        g_coarse_frac-= 1000;
+        g_coarse_ticks++;
+    }
+}
+
+// Set the coarse timestamp to 'timestamp' rounded down to a whole period, and
+// the next boundary to the period after that. Whole seconds are split off,
+// so the exact calculations do not overflow.
+static void sync_coarse(uint64_t timestamp)
+{
+    const uint64_t rate = g_timebase.tick_rate;
+    const uint64_t ms = (timestamp / rate) * 1000
+        + ((timestamp % rate) * 1000) / rate;
+    const uint64_t periods = ms / DELAY_COARSE_PERIOD_MS;
+    g_state.coarse_ms = periods * DELAY_COARSE_PERIOD_MS;
+
+    const uint64_t next_ms = (periods + 1) * DELAY_COARSE_PERIOD_MS;
+    const uint64_t rest = (next_ms % 1000) * rate;
+    g_coarse_ticks = (next_ms / 1000) * rate + (rest / 1000);
+    g_coarse_frac = rest % 1000;
+}
+#endif
+
 
 #if (DELAY_OWNER)
+// Timer prescaler: run at the full timer clock, or at about 1Mhz
+static uint32_t get_prescaler(void)
+{
+#if (DELAY_TIMER_FULL_RATE)
+    return 0;
+#else
+    const uint32_t cpu_freq_MHz = get_timer_clock_rate() / 1000000;
+    return cpu_freq_MHz-1;
+#endif
+}
+
 static void timer_init(uint32_t offset_ticks)
 {
     // Enable timer clock and reset it
@@ -132,11 +274,9 @@ static void timer_init(uint32_t offset_ticks)
     reset_timer();
     Chip_TIMER_Reset(DELAY_TIMER);
 
-    // run timer at 1Mhz
-    const uint32_t cpu_freq_MHz = get_timer_clock_rate() / 1000000;
-    Chip_TIMER_PrescaleSet(DELAY_TIMER, cpu_freq_MHz-1);
+    Chip_TIMER_PrescaleSet(DELAY_TIMER, get_prescaler());
 
-    // interrupt on overflow (2^32 microseconds)
+    // interrupt on overflow (2^32 ticks)
     // Match 1: interrupt to handle overflow
     Chip_TIMER_MatchEnableInt(DELAY_TIMER, 1);
     Chip_TIMER_SetMatch(DELAY_TIMER, 1, 0xFFFFFFFF);
@@ -147,6 +287,19 @@ static void timer_init(uint32_t offset_ticks)
     Chip_TIMER_SetMatch(DELAY_TIMER, 2, TIMER_HALFWAY);
     Chip_TIMER_ResetOnMatchDisable(DELAY_TIMER, 2);
 
+    // Match 0: one-shot alarm for delay_timer callbacks, armed on demand
+    Chip_TIMER_MatchDisableInt(DELAY_TIMER, TIMER_ALARM_MATCH);
+    Chip_TIMER_ResetOnMatchDisable(DELAY_TIMER, TIMER_ALARM_MATCH);
+    Chip_TIMER_StopOnMatchDisable(DELAY_TIMER, TIMER_ALARM_MATCH);
+
+#if (DELAY_COARSE_PERIOD_MS)
+    // Match 3: periodic interrupt for the coarse timestamp. The first match
+    // is on the next period boundary (see init_coarse())
+    Chip_TIMER_SetMatch(DELAY_TIMER, TIMER_COARSE_MATCH, coarse_match());
+    Chip_TIMER_MatchEnableInt(DELAY_TIMER, TIMER_COARSE_MATCH);
+    Chip_TIMER_ResetOnMatchDisable(DELAY_TIMER, TIMER_COARSE_MATCH);
+#endif
+
     DELAY_TIMER->TC = offset_ticks;
 
     // Enable timer interrupt
@@ -166,34 +319,145 @@ static void timer_deinit(void)
 
 void DELAY_IRQHandler(void)
 {
-    const bool new_index = !(g_state.index);
-    TimeInfo *new_time = &g_state.time[new_index];
+    const bool overflow = Chip_TIMER_MatchPending(DELAY_TIMER, 1);
+    const bool halfway = Chip_TIMER_MatchPending(DELAY_TIMER, 2);
+
+    // Only publish new time info if it changed: new_time is not written
+    // otherwise, and still holds the info from two updates ago
+    if (overflow || halfway) {
+        const bool new_index = !(g_state.index);
+        TimeInfo *new_time = &g_state.time[new_index];
 
-    const uint32_t ovf_count = (g_state.time[g_state.index].overflow_count);
+        const uint32_t ovf_count = (g_state.time[g_state.index].overflow_count);
 
-    if (Chip_TIMER_MatchPending(DELAY_TIMER, 1)) {
-        Chip_TIMER_ClearMatch(DELAY_TIMER, 1);
+        if (overflow) {
+            Chip_TIMER_ClearMatch(DELAY_TIMER, 1);
 
-        // Overflow: increment overflow_count
-        new_time->overflow_count = ovf_count + 1;
-        new_time->past_halfway = false;
+            // Overflow: increment overflow_count
+            new_time->overflow_count = ovf_count + 1;
+            new_time->past_halfway = false;
+        }
+
+        if (halfway) {
+            Chip_TIMER_ClearMatch(DELAY_TIMER, 2);
+
+            // Timer is halfway: set 'past_halfway' flag
+            new_time->overflow_count = ovf_count;
+            new_time->past_halfway = true;
+        }
+
+        __DMB();
+        g_state.index = new_index;
     }
 
-    if (Chip_TIMER_MatchPending(DELAY_TIMER, 2)) {
-        Chip_TIMER_ClearMatch(DELAY_TIMER, 2);
+#if (DELAY_COARSE_PERIOD_MS)
+    if (Chip_TIMER_MatchPending(DELAY_TIMER, TIMER_COARSE_MATCH)) {
+        Chip_TIMER_ClearMatch(DELAY_TIMER, TIMER_COARSE_MATCH);
+
+        coarse_next_period();
+        g_state.coarse_ms+= DELAY_COARSE_PERIOD_MS;
+        Chip_TIMER_SetMatch(DELAY_TIMER, TIMER_COARSE_MATCH, coarse_match());
+
+        // If the irq was more than a period late, the new match already
+        // passed and would only trigger after the timer wraps: start again
+        // from the current time
+        while ((int32_t)(coarse_match() - DELAY_TIMER->TC) <= 0) {
+            sync_coarse(delay_get_timestamp());
+            Chip_TIMER_SetMatch(DELAY_TIMER, TIMER_COARSE_MATCH,
+                    coarse_match());
+        }
+    }
+#endif
 
-        // Timer is halfway: set 'past_halfway' flag
-        new_time->overflow_count = ovf_count;
-        new_time->past_halfway = true;
+    // The alarm may also be triggered in software (deadline already passed),
+    // so always check for due callbacks. This is cheap if nothing is due.
+    if (Chip_TIMER_MatchPending(DELAY_TIMER, TIMER_ALARM_MATCH)) {
+        Chip_TIMER_ClearMatch(DELAY_TIMER, TIMER_ALARM_MATCH);
     }
+    delay_timer_irq_handler();
+}
 
-    __DMB();
-    g_state.index = new_index;
+void delay_timer_platform_arm(uint64_t deadline)
+{
+    // Only the lower 32 bits can be matched: for deadlines further away
+    // the irq triggers early, delay_timer_irq_handler() will re-arm it.
+    Chip_TIMER_SetMatch(DELAY_TIMER, TIMER_ALARM_MATCH, (uint32_t)deadline);
+    Chip_TIMER_MatchEnableInt(DELAY_TIMER, TIMER_ALARM_MATCH);
+
+    // The timer may have passed the match value before it was set
+    if (delay_get_timestamp() >= deadline) {
+        NVIC_SetPendingIRQ(DELAY_TIMER_IRQn);
+    }
+}
+
+void delay_timer_platform_disarm(void)
+{
+    Chip_TIMER_MatchDisableInt(DELAY_TIMER, TIMER_ALARM_MATCH);
+}
+
+static void wake_cb(void *ctx)
+{
+    *((volatile bool *)ctx) = true;
+}
+
+// Sleep until 'wakeup' if possible. Returns as soon as the alarm fired.
+static void sleep_until(uint64_t wakeup)
+{
+    // In an irq, the timer irq may not be able to preempt: never wake up.
+    // With interrupts masked, the alarm callback would never run.
+    if(__get_IPSR() || __get_PRIMASK()) {
+        return;
+    }
+
+    volatile bool woken = false;
+    if(delay_timer_schedule(wakeup, wake_cb, (void *)&woken) < 0) {
+        return;
+    }
+
+    // Check the flag with interrupts masked: if the alarm fires between the
+    // check and the WFI, the WFI still returns because the irq is pending
+    while(1) {
+        __disable_irq();
+        if(woken) {
+            __enable_irq();
+            break;
+        }
+        __WFI();
+        __enable_irq();
+    }
+}
+
+void delay_timer_platform_lock(void)
+{
+    NVIC_DisableIRQ(DELAY_TIMER_IRQn);
+}
+
+void delay_timer_platform_unlock(void)
+{
+    NVIC_EnableIRQ(DELAY_TIMER_IRQn);
+}
+
+// Start the coarse timestamp at 'timestamp': it is rounded down to a whole
+// period, the first match is at the next period boundary
+static void init_coarse(uint64_t timestamp)
+{
+#if (DELAY_COARSE_PERIOD_MS)
+    const uint64_t period = ((uint64_t)DELAY_COARSE_PERIOD_MS)
+        * g_timebase.tick_rate;
+    g_coarse_period = period / 1000;
+    g_coarse_period_frac = period % 1000;
+    sync_coarse(timestamp);
+#else
+    (void)timestamp;
+#endif
 }
 
 void delay_init(void)
 {
     memset(&g_state, 0, sizeof(g_state));
+    delay_timer_init();
+    init_timebase(get_timer_clock_rate() / (get_prescaler() + 1));
+    init_coarse(0);
     timer_init(0);
 }
 
@@ -217,10 +481,174 @@ void delay_reinit(uint64_t initial_timestamp)
     __DMB();
     g_state.index = new_index;
 
+    init_timebase(get_timer_clock_rate() / (get_prescaler() + 1));
+    init_coarse(initial_timestamp);
     timer_init(lo_offset);
 }
 #endif
 
+#else
+
+//
+// Host backend: timestamps are derived from CLOCK_MONOTONIC_RAW, which is
+// not affected by NTP adjustments and is read through the vDSO (rdtsc based
+// on x86) without a system call. Just like the MCU timer, one tick is one
+// microsecond, or one nanosecond with DELAY_TIMER_FULL_RATE.
+//
+// SIGALRM plays the role of the timer interrupt for delay_timer callbacks.
+//
+
+static struct {
+    // timestamp = clock + offset (modulo 2^64)
+    volatile uint64_t offset;
+    // coarse timestamp = coarse clock + coarse_offset (modulo 2^32)
+    volatile uint32_t coarse_offset;
+    volatile bool in_irq;
+} g_state;
+
+#if defined(CLOCK_MONOTONIC_COARSE)
+    #define HOST_COARSE_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+    #define HOST_COARSE_CLOCK CLOCK_MONOTONIC
+#endif
+
+static uint32_t host_clock_ms(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (((uint64_t)ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
+
+#if (DELAY_TIMER_FULL_RATE)
+    #define HOST_TICK_RATE (1000000000)
+#else
+    #define HOST_TICK_RATE (1000000)
+#endif
+
+static uint64_t host_clock_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (((uint64_t)ts.tv_sec) * HOST_TICK_RATE)
+        + (ts.tv_nsec / (1000000000 / HOST_TICK_RATE));
+}
+
+static void alarm_handler(int sig)
+{
+    g_state.in_irq = true;
+    delay_timer_irq_handler();
+    g_state.in_irq = false;
+}
+
+// Set the alarm 'ticks' from now, or disarm it if 'ticks' is 0
+static void set_alarm(uint64_t ticks)
+{
+    // Round up: a sub-microsecond delay must not become 0 (disarm)
+    uint64_t microseconds = delay_ticks_to_us(ticks);
+    if(delay_us_to_ticks(microseconds) < ticks) {
+        microseconds++;
+    }
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = microseconds / 1000000;
+    timer.it_value.tv_usec = microseconds % 1000000;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+void delay_timer_platform_arm(uint64_t deadline)
+{
+    const uint64_t now = delay_get_timestamp();
+    if(now >= deadline) {
+        // delivered as soon as the lock is released
+        set_alarm(0);
+        raise(SIGALRM);
+        return;
+    }
+    set_alarm(deadline - now);
+}
+
+void delay_timer_platform_disarm(void)
+{
+    set_alarm(0);
+}
+
+static void sleep_until(uint64_t wakeup)
+{
+    // A signal (e.g. the delay_timer alarm) interrupts the sleep: sleep again
+    uint64_t now;
+    while((now = delay_get_timestamp()) < wakeup) {
+        const uint64_t remaining = delay_ticks_to_ns(wakeup - now);
+        struct timespec ts;
+        ts.tv_sec = remaining / 1000000000;
+        ts.tv_nsec = remaining % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+    }
+}
+
+static void set_alarm_blocked(bool blocked)
+{
+    // Like an irq, the signal handler can not be interrupted by itself
+    if(g_state.in_irq) {
+        return;
+    }
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(blocked ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+}
+
+void delay_timer_platform_lock(void)
+{
+    set_alarm_blocked(true);
+}
+
+void delay_timer_platform_unlock(void)
+{
+    set_alarm_blocked(false);
+}
+
+void delay_init(void)
+{
+    delay_deinit();
+    delay_timer_init();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = alarm_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, NULL);
+
+    init_timebase(HOST_TICK_RATE);
+    delay_reinit(0);
+}
+
+void delay_deinit(void)
+{
+    set_alarm(0);
+    signal(SIGALRM, SIG_DFL);
+}
+
+void delay_reinit(uint64_t initial_timestamp)
+{
+    g_state.offset = initial_timestamp - host_clock_ticks();
+    // Relative to the precise version of the coarse clock: the coarse clock
+    // lags it by up to a kernel tick, so the coarse timestamp is never ahead
+    g_state.coarse_offset = (uint32_t)(delay_ticks_to_us(initial_timestamp)
+            / 1000) - host_clock_ms(CLOCK_MONOTONIC);
+}
+
+uint64_t delay_get_timestamp()
+{
+    return host_clock_ticks() + g_state.offset;
+}
+
+uint32_t delay_get_timestamp_coarse(void)
+{
+    return host_clock_ms(HOST_COARSE_CLOCK) + g_state.coarse_offset;
+}
+
+#endif
+
 
 
 //
@@ -228,6 +656,7 @@ void delay_reinit(uint64_t initial_timestamp)
 //
 
 
+#if (!defined(MCU_PLATFORM_host))
 uint64_t delay_get_timestamp()
 {
     uint32_t hi_count;
@@ -262,30 +691,117 @@ uint64_t delay_get_timestamp()
     return (((uint64_t)hi_count) << 32) | lo_count;
 }
 
+uint32_t delay_get_timestamp_coarse(void)
+{
+#if (DELAY_COARSE_PERIOD_MS)
+    return g_state.coarse_ms;
+#else
+    return delay_ticks_to_us(delay_get_timestamp()) / 1000;
+#endif
+}
+#endif
+
+uint32_t delay_get_tick_rate(void)
+{
+    return g_timebase.tick_rate;
+}
+
+static uint64_t convert(const Conversion *conversion, uint64_t value)
+{
+    // 64 x 32 bit multiply in two halves: the 96-bit product is
+    // (upper << 32) | lower
+    const uint64_t lo = (value & 0xFFFFFFFF) * conversion->mult;
+    const uint64_t upper = ((value >> 32) * conversion->mult) + (lo >> 32);
+    const uint32_t lower = lo;
+    const uint32_t shift = conversion->shift;
+
+    uint64_t result;
+    bool inexact;
+    if(shift >= 32) {
+        const uint64_t mask = (1ULL << (shift - 32)) - 1;
+        result = upper >> (shift - 32);
+        inexact = lower || (upper & mask);
+    } else {
+        const uint32_t mask = (1UL << shift) - 1;
+        result = (upper << (32 - shift)) | (lower >> shift);
+        inexact = (lower & mask);
+    }
+    return result + (conversion->round_up && inexact);
+}
+
+uint64_t delay_ticks_to_ns(uint64_t ticks)
+{
+    return convert(&g_timebase.ticks_to_ns, ticks);
+}
+
+uint64_t delay_ns_to_ticks(uint64_t nanoseconds)
+{
+    return convert(&g_timebase.ns_to_ticks, nanoseconds);
+}
+
+uint64_t delay_ticks_to_us(uint64_t ticks)
+{
+    return convert(&g_timebase.ticks_to_us, ticks);
+}
+
+uint64_t delay_us_to_ticks(uint64_t microseconds)
+{
+    return convert(&g_timebase.us_to_ticks, microseconds);
+}
+
 uint64_t delay_calc_time_us(uint64_t start_timestamp, uint64_t end_timestamp)
 {
     if(start_timestamp > end_timestamp) {
         return 0;
     }
 
-    return end_timestamp - start_timestamp;
+    return delay_ticks_to_us(end_timestamp - start_timestamp);
 }
 
 void delay_us(uint64_t microseconds)
 {
+#if (DELAY_US_SLEEP)
+    delay_us_sleep(microseconds);
+#else
     delay_timeout_t timeout;
     delay_timeout_set(&timeout, microseconds);
     while(!delay_timeout_done(&timeout)) {}
+#endif
+}
+
+void delay_us_sleep(uint64_t microseconds)
+{
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, microseconds);
+
+#if (DELAY_OWNER)
+    if(microseconds > DELAY_SPIN_US) {
+        sleep_until(timeout.target_timestamp
+                - delay_us_to_ticks(DELAY_SPIN_US));
+    }
+#endif
+    while(!delay_timeout_done(&timeout)) {}
 }
 
 void delay_timeout_set(delay_timeout_t *timeout, uint64_t microseconds)
 {
-    timeout->target_timestamp = delay_get_timestamp() + microseconds;
+    delay_timeout_set_at(timeout, delay_get_timestamp(), microseconds);
 }
 
 bool delay_timeout_done(delay_timeout_t *timeout)
 {
-    return (delay_get_timestamp() >= timeout->target_timestamp);
+    return delay_timeout_done_at(timeout, delay_get_timestamp());
+}
+
+void delay_timeout_set_at(delay_timeout_t *timeout, uint64_t now,
+        uint64_t microseconds)
+{
+    timeout->target_timestamp = now + delay_us_to_ticks(microseconds);
+}
+
+bool delay_timeout_done_at(delay_timeout_t *timeout, uint64_t now)
+{
+    return (now >= timeout->target_timestamp);
 }
 
 // Delay using a loop (deprecated).
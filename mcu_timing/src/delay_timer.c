@@ -0,0 +1,200 @@
+#include "delay_timer.h"
+#include "deadline_heap.h"
+
+#if (DELAY_OWNER)
+
+#if (DELAY_TIMER_MAX_SCHEDULED > 255)
+    #error DELAY_TIMER_MAX_SCHEDULED should be 255 or less
+#endif
+
+/**
+ * Each scheduled callback occupies a slot. The heap orders the slots by
+ * deadline. A handle is the slot index plus a generation count, so a stale
+ * handle can not cancel a newer callback that re-uses the same slot.
+ */
+typedef struct {
+    DelayTimerCB cb;
+    void *ctx;
+    uint16_t generation;
+    uint16_t pass;      // irq pass during which the slot was scheduled
+} DelayTimerSlot;
+
+static struct {
+    DeadlineHeap heap;
+    DeadlineHeapNode nodes[DELAY_TIMER_MAX_SCHEDULED];
+    uint16_t positions[DELAY_TIMER_MAX_SCHEDULED];
+    DelayTimerSlot slots[DELAY_TIMER_MAX_SCHEDULED];
+
+    // The heap is ordered by the (earliest) deadline, the timer is armed for
+    // the earliest deadline + slack
+    uint64_t slack[DELAY_TIMER_MAX_SCHEDULED];
+    DelayTimerStats stats;
+
+    bool armed;
+    uint64_t armed_deadline;
+
+    // Incremented for each run of the irq handler
+    uint16_t pass;
+} g_timers;
+
+
+static int make_handle(uint16_t slot)
+{
+    return (g_timers.slots[slot].generation << 8) | slot;
+}
+
+// Program the hardware for the earliest deadline. Call with the lock held.
+// If 'force' is set, the platform is re-armed even if the deadline is the same.
+static void reprogram(bool force)
+{
+    uint64_t deadline;
+    if(!deadline_heap_peek_latest(&g_timers.heap, g_timers.slack, &deadline)) {
+        if(g_timers.armed || force) {
+            g_timers.armed = false;
+            delay_timer_platform_disarm();
+        }
+        return;
+    }
+
+    if(force || !g_timers.armed || (deadline != g_timers.armed_deadline)) {
+        g_timers.armed = true;
+        g_timers.armed_deadline = deadline;
+        delay_timer_platform_arm(deadline);
+    }
+}
+
+void delay_timer_init(void)
+{
+    deadline_heap_init(&g_timers.heap, g_timers.nodes, g_timers.positions,
+            DELAY_TIMER_MAX_SCHEDULED);
+    for(int i=0; i < DELAY_TIMER_MAX_SCHEDULED; i++) {
+        g_timers.slots[i].cb = 0;
+        g_timers.slots[i].ctx = 0;
+        g_timers.slack[i] = 0;
+    }
+    g_timers.stats.wakeups = 0;
+    g_timers.stats.callbacks = 0;
+    g_timers.armed = false;
+    g_timers.pass = 0;
+}
+
+int delay_timer_schedule(uint64_t deadline, DelayTimerCB cb, void *ctx)
+{
+    return delay_timer_schedule_slack(deadline, 0, cb, ctx);
+}
+
+int delay_timer_schedule_slack(uint64_t deadline, uint64_t slack_us,
+        DelayTimerCB cb, void *ctx)
+{
+    if(!cb) {
+        return -1;
+    }
+
+    const uint64_t slack = delay_us_to_ticks(slack_us);
+
+    int handle = -1;
+    delay_timer_platform_lock();
+
+    for(uint16_t i=0; i < DELAY_TIMER_MAX_SCHEDULED; i++) {
+        if(deadline_heap_contains(&g_timers.heap, i)) {
+            continue;
+        }
+        DelayTimerSlot *slot = &g_timers.slots[i];
+        slot->cb = cb;
+        slot->ctx = ctx;
+        slot->generation = (slot->generation + 1) & 0x7FFF;
+        slot->pass = g_timers.pass;
+        g_timers.slack[i] = slack;
+        deadline_heap_set(&g_timers.heap, i, deadline);
+
+        handle = make_handle(i);
+        reprogram(false);
+        break;
+    }
+
+    delay_timer_platform_unlock();
+    return handle;
+}
+
+bool delay_timer_cancel(int handle)
+{
+    if(handle < 0) {
+        return false;
+    }
+    const uint16_t i = handle & 0xFF;
+    if(i >= DELAY_TIMER_MAX_SCHEDULED) {
+        return false;
+    }
+
+    bool cancelled = false;
+    delay_timer_platform_lock();
+
+    if((make_handle(i) == handle)
+            && deadline_heap_remove(&g_timers.heap, i)) {
+        cancelled = true;
+        reprogram(false);
+    }
+
+    delay_timer_platform_unlock();
+    return cancelled;
+}
+
+int delay_timer_count_scheduled(void)
+{
+    return g_timers.heap.size;
+}
+
+void delay_timer_get_stats(DelayTimerStats *stats)
+{
+    delay_timer_platform_lock();
+    *stats = g_timers.stats;
+    delay_timer_platform_unlock();
+}
+
+void delay_timer_irq_handler(void)
+{
+    const uint64_t now = delay_get_timestamp();
+
+    delay_timer_platform_lock();
+    const uint16_t pass = ++g_timers.pass;
+
+    // Everything with an open window runs now, so it does not need
+    // another wake-up later. A callback that re-schedules with a deadline
+    // in the past is not run again in this pass: it would never let the
+    // loop finish. It stays in the heap and the re-arm below triggers
+    // the irq again for it.
+    uint16_t i;
+    uint64_t deadline;
+    bool called = false;
+    while((i = deadline_heap_peek(&g_timers.heap, &deadline))
+            != DEADLINE_HEAP_NONE) {
+        if((deadline > now) || (g_timers.slots[i].pass == pass)) {
+            break;
+        }
+        deadline_heap_remove(&g_timers.heap, i);
+        const DelayTimerSlot slot = g_timers.slots[i];
+        g_timers.stats.callbacks++;
+        called = true;
+
+        // The callback may (re-)schedule timers: don't hold the lock
+        delay_timer_platform_unlock();
+        slot.cb(slot.ctx);
+        delay_timer_platform_lock();
+    }
+
+    // The irq also runs for other timer events (overflow, the coarse
+    // timestamp, early triggers for far deadlines): only count a wake-up
+    // if it was for a callback
+    if(called) {
+        g_timers.stats.wakeups++;
+    }
+
+    // The irq may have been triggered early (only part of the deadline is
+    // matched in hardware): always re-arm. If the next deadline already passed
+    // while running the callbacks, the platform triggers the irq again.
+    reprogram(true);
+
+    delay_timer_platform_unlock();
+}
+
+#endif
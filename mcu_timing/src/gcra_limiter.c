@@ -0,0 +1,113 @@
+#include "gcra_limiter.h"
+#include "delay.h"
+
+// Current time in units of 1/num_req_per_interval microseconds
+static uint64_t now_units(const TokenBucketPolicy *policy, uint64_t now)
+{
+    const uint64_t now_us = delay_calc_time_us(0, now);
+    return now_us * policy->num_req_per_interval;
+}
+
+void gcra_limiter_init(GcraLimiter *limiter, const TokenBucketPolicy *policy)
+{
+    limiter->policy = policy;
+    limiter->tat = 0;
+}
+
+/*
+ * Each event costs interval_us units, and the TAT may be at most
+ * max_tokens * interval_us units ahead of the current time.
+ * Returns the amount of units to wait, 0 if allowed. 'new_tat' is set to
+ * the TAT after claiming the events.
+ */
+static uint64_t calc_wait(const GcraLimiter *limiter, unsigned int num_events,
+        uint64_t now, uint64_t *new_tat)
+{
+    const TokenBucketPolicy *policy = limiter->policy;
+    const uint64_t limit = ((uint64_t)policy->max_tokens) * policy->interval_us;
+    const uint64_t cost = ((uint64_t)num_events) * policy->interval_us;
+
+    const uint64_t base = (limiter->tat > now) ? limiter->tat : now;
+    *new_tat = base + cost;
+
+    const uint64_t ahead = *new_tat - now;
+    return (ahead > limit) ? (ahead - limit) : 0;
+}
+
+static uint64_t units_to_us(const TokenBucketPolicy *policy, uint64_t units)
+{
+    const uint64_t n = policy->num_req_per_interval;
+    return (units + n - 1) / n;
+}
+
+bool gcra_limiter_allowed(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t *wait_us)
+{
+    return gcra_limiter_allowed_at(limiter, num_events, wait_us,
+            delay_get_timestamp());
+}
+
+bool gcra_limiter_allowed_at(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t *wait_us, uint64_t now)
+{
+    const TokenBucketPolicy *policy = limiter->policy;
+    if((num_events > policy->max_tokens) || !policy->num_req_per_interval) {
+        if(wait_us) {
+            *wait_us = UINT64_MAX;
+        }
+        return false;
+    }
+
+    uint64_t new_tat;
+    const uint64_t wait = calc_wait(limiter, num_events,
+            now_units(policy, now), &new_tat);
+    if(wait_us) {
+        *wait_us = wait ? units_to_us(policy, wait) : 0;
+    }
+    if(wait) {
+        return false;
+    }
+    limiter->tat = new_tat;
+    return true;
+}
+
+uint64_t gcra_limiter_wait_us(GcraLimiter *limiter, unsigned int num_events)
+{
+    return gcra_limiter_wait_us_at(limiter, num_events, delay_get_timestamp());
+}
+
+uint64_t gcra_limiter_wait_us_at(GcraLimiter *limiter, unsigned int num_events,
+        uint64_t now)
+{
+    const TokenBucketPolicy *policy = limiter->policy;
+    if((num_events > policy->max_tokens) || !policy->num_req_per_interval) {
+        return UINT64_MAX;
+    }
+
+    uint64_t new_tat;
+    const uint64_t wait = calc_wait(limiter, num_events,
+            now_units(policy, now), &new_tat);
+    return units_to_us(policy, wait);
+}
+
+unsigned int gcra_limiter_count_available(GcraLimiter *limiter)
+{
+    return gcra_limiter_count_available_at(limiter, delay_get_timestamp());
+}
+
+unsigned int gcra_limiter_count_available_at(GcraLimiter *limiter,
+        uint64_t now)
+{
+    const TokenBucketPolicy *policy = limiter->policy;
+    if(!policy->num_req_per_interval) {
+        return 0;
+    }
+    if(!policy->interval_us) {
+        return policy->max_tokens;
+    }
+
+    const uint64_t now_u = now_units(policy, now);
+    const uint64_t limit = ((uint64_t)policy->max_tokens) * policy->interval_us;
+    const uint64_t ahead = (limiter->tat > now_u) ? (limiter->tat - now_u) : 0;
+    return (limit - ahead) / policy->interval_us;
+}
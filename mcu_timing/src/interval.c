@@ -1,4 +1,12 @@
 #include "interval.h"
+#include "delay.h"
+#include "atomic_u32.h"
+
+#if (INTERVAL_TICKLESS)
+    #define is_tickless(interval_list) ((interval_list)->tickless)
+#else
+    #define is_tickless(interval_list) (false)
+#endif
 
 void interval_init(IntervalList *interval_list)
 {
@@ -6,16 +14,117 @@ void interval_init(IntervalList *interval_list)
     interval_list->last_time = 0;
     interval_list->counter = 0;
     interval_list->poll_required = false;
+    interval_list->stagger = false;
+    interval_list->num_scheduled = 0;
+
+#if (INTERVAL_QUEUE)
+    interval_list->queue_head = 0;
+    interval_list->queue_tail = 0;
+#endif
+
+#if (INTERVAL_WHEEL)
+    timer_wheel_init(&interval_list->wheel, interval_list->wheel_entries,
+            MAX_INTERVALS, 0);
+#endif
+
+#if (INTERVAL_TICKLESS)
+    interval_list->tickless = false;
+    deadline_heap_init(&interval_list->heap, interval_list->heap_nodes,
+            interval_list->heap_positions, MAX_INTERVALS);
+#endif
 }
 
+#if (INTERVAL_TICKLESS)
+void interval_init_tickless(IntervalList *interval_list)
+{
+    interval_init(interval_list);
+    interval_list->tickless = true;
+}
+#endif
+
+void interval_set_stagger(IntervalList *interval_list, bool enable)
+{
+    interval_list->stagger = enable;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while(b) {
+        const uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Tick mode: the offset for a new interval with the least collisions with
+// the existing intervals. Interval j collides with offset o every
+// lcm(time, time_j) ticks if o == offset_j (mod gcd(time, time_j)): the cost
+// of a collision is its frequency, gcd / time_j (the common 1/time is left
+// out).
+static uint32_t tick_offset(const IntervalList *interval_list, uint32_t time)
+{
+    const uint32_t candidates = (time < INTERVAL_STAGGER_CANDIDATES)
+        ? time : INTERVAL_STAGGER_CANDIDATES;
+
+    uint32_t best = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for(uint32_t c=0; c < candidates; c++) {
+        // evenly spread over [0, time)
+        const uint32_t offset = ((uint64_t)c * time) / candidates;
+
+        uint64_t cost = 0;
+        for(int j=0; j < interval_list->num_intervals; j++) {
+            const Interval *other = &interval_list->intervals[j];
+            const uint32_t g = gcd(time, other->time);
+            if((offset % g) == (other->offset % g)) {
+                cost+= (((uint64_t)g) << 32) / other->time;
+            }
+        }
+        if(cost < best_cost) {
+            best = offset;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+#if (INTERVAL_TICKLESS)
+// Tickless mode: a golden ratio fraction of the interval time
+static uint32_t tickless_offset(const IntervalList *interval_list,
+        uint32_t time)
+{
+    const uint32_t fraction = interval_list->num_intervals * 0x9E3779B9UL;
+    return (((uint64_t)fraction) * time) >> 32;
+}
+#endif
+
 bool interval_add(IntervalList *interval_list, uint32_t time, IntervalCB cb)
 {
+    if (!time) {
+        return false;
+    }
     if (interval_list->num_intervals < MAX_INTERVALS) {
         Interval *interval = 
             &interval_list->intervals[interval_list->num_intervals];
         interval->time = time;
+        interval->offset = 0;
+        if(interval_list->stagger) {
+#if (INTERVAL_TICKLESS)
+            interval->offset = interval_list->tickless
+                ? tickless_offset(interval_list, time)
+                : tick_offset(interval_list, time);
+#else
+            interval->offset = tick_offset(interval_list, time);
+#endif
+        }
         interval->cb = cb;
         interval->reached = false;
+        interval->missed = 0;
+#if (INTERVAL_QUEUE)
+        interval->last_latency = 0;
+        interval->max_latency = 0;
+#endif
         interval_list->num_intervals += 1;
         return true;
     }
@@ -27,36 +136,251 @@ bool interval_is_poll_required(IntervalList *interval_list)
     return interval_list->poll_required;
 }
 
-void interval_poll(IntervalList *interval_list)
+// Stop calling callbacks once 'budget_us' passed since 'start'. At least one
+// callback is called.
+static bool budget_exceeded(bool limited, bool called, uint64_t start,
+        uint32_t budget_us)
+{
+    return limited && called
+        && (delay_calc_time_us(start, delay_get_timestamp()) >= budget_us);
+}
+
+#if (INTERVAL_QUEUE)
+// Call the queued callbacks. If 'limited', stop when 'budget_us' passed.
+static void dispatch(IntervalList *interval_list, bool limited,
+        uint32_t budget_us)
+{
+    // immediately set to false: if an IRQ happens during this call,
+    // poll_required may be set to true again
+    interval_list->poll_required = false;
+
+    // Only callbacks that were queued before this call: later ones set
+    // poll_required again
+    uint32_t tail = interval_list->queue_tail;
+    const uint32_t head = atomic_u32_load(&interval_list->queue_head);
+    const uint64_t start = limited ? delay_get_timestamp() : 0;
+    bool called = false;
+
+    while(tail != head) {
+        if(budget_exceeded(limited, called, start, budget_us)) {
+            // Carry over the rest
+            interval_list->poll_required = true;
+            break;
+        }
+
+        const IntervalEvent event = interval_list->queue[tail];
+        Interval *interval = &interval_list->intervals[event.index];
+
+        const uint64_t now = is_tickless(interval_list)
+            ? delay_get_timestamp() : interval_list->counter;
+        const uint64_t latency = is_tickless(interval_list)
+            ? delay_calc_time_us(event.due, now)
+            : (now - event.due);
+        interval->last_latency = (latency > UINT32_MAX) ? UINT32_MAX : latency;
+        if(interval->last_latency > interval->max_latency) {
+            interval->max_latency = interval->last_latency;
+        }
+
+        // The irq handler may queue this interval again from here on
+        interval->reached = false;
+        if(++tail == INTERVAL_QUEUE_SLOTS) {
+            tail = 0;
+        }
+        atomic_u32_store(&interval_list->queue_tail, tail);
+
+        if(interval->cb) {
+            interval->cb();
+        }
+        called = true;
+    }
+}
+
+#else
+// Call the callbacks of the reached intervals, in the order in which the
+// intervals were added. If 'limited', stop when 'budget_us' passed.
+static void dispatch(IntervalList *interval_list, bool limited,
+        uint32_t budget_us)
 {
     // immediately set to false: if an IRQ happens during this call,
     // poll_required may be set to true again
     interval_list->poll_required = false;
 
+    const uint64_t start = limited ? delay_get_timestamp() : 0;
+    bool called = false;
+
     for(int i=0; i < interval_list->num_intervals; i++) {
-        Interval *interval = 
-            &interval_list->intervals[i];
-        if (interval->reached && interval->cb) {
-            interval->reached = false;
+        Interval *interval = &interval_list->intervals[i];
+        if(!interval->reached) {
+            continue;
+        }
+        if(budget_exceeded(limited, called, start, budget_us)) {
+            // Carry over the rest
+            interval_list->poll_required = true;
+            break;
+        }
+
+        // The irq handler may mark this interval again from here on
+        interval->reached = false;
+        if(interval->cb) {
             interval->cb();
         }
+        called = true;
+    }
+}
+#endif
+
+void interval_poll(IntervalList *interval_list)
+{
+    dispatch(interval_list, false, 0);
+}
+
+void interval_poll_budget(IntervalList *interval_list, uint32_t budget_us)
+{
+    dispatch(interval_list, true, budget_us);
+}
+
+// Queue the callback of an interval that is due (irq handler side).
+// If the previous one was not handled yet, the period is counted as missed.
+static void queue_event(IntervalList *interval_list, uint16_t i, uint64_t due)
+{
+    Interval *interval = &interval_list->intervals[i];
+    if(interval->reached) {
+        interval->missed += 1;
+        return;
+    }
+    interval->reached = true;
+
+#if (INTERVAL_QUEUE)
+    uint32_t head = interval_list->queue_head;
+    interval_list->queue[head] = (IntervalEvent){.due = due, .index = i};
+    if(++head == INTERVAL_QUEUE_SLOTS) {
+        head = 0;
+    }
+    atomic_u32_store(&interval_list->queue_head, head);
+#else
+    (void)due;
+#endif
+    interval_list->poll_required = true;
+}
+
+#if (INTERVAL_WHEEL)
+// Schedule intervals that were added since the last irq: the first
+// callback is due at the next multiple of its interval time.
+static void schedule_new_intervals(IntervalList *interval_list)
+{
+    const uint32_t counter = interval_list->counter;
+
+    while(interval_list->num_scheduled < interval_list->num_intervals) {
+        const int i = interval_list->num_scheduled;
+        const uint32_t time = interval_list->intervals[i].time;
+        const uint32_t offset = interval_list->intervals[i].offset;
+
+        // first tick where counter % time == offset
+        const uint32_t ticks =
+            (((uint64_t)offset) + time - (counter % time)) % time;
+        timer_wheel_add(&interval_list->wheel, i, ticks ? ticks : time);
+        interval_list->num_scheduled += 1;
     }
 }
 
+#else
+// Pick up intervals that were added since the last irq: they are checked
+// from the next tick on.
+static void schedule_new_intervals(IntervalList *interval_list)
+{
+    interval_list->num_scheduled = interval_list->num_intervals;
+}
+#endif
+
 void interval_irq_handler(IntervalList *interval_list, uint32_t time)
 {
+    if(is_tickless(interval_list)) {
+        return;
+    }
     if(!time || (time == interval_list->last_time)) {
         return;
     }
     interval_list->last_time = time;
+
+    schedule_new_intervals(interval_list);
+
     interval_list->counter += 1;
 
-    for(int i=0; i < interval_list->num_intervals; i++) {
-        Interval *interval = 
-            &interval_list->intervals[i];
-        if (!(interval_list->counter % interval->time)) {
-            interval->reached = true;
-            interval_list->poll_required = true;
+#if (INTERVAL_WHEEL)
+    timer_wheel_tick(&interval_list->wheel);
+
+    uint16_t i;
+    while((i = timer_wheel_pop_expired(&interval_list->wheel))
+            != TIMER_WHEEL_NONE) {
+        queue_event(interval_list, i, interval_list->counter);
+        timer_wheel_add(&interval_list->wheel, i,
+                interval_list->intervals[i].time);
+    }
+#else
+    const uint32_t counter = interval_list->counter;
+    for(int i=0; i < interval_list->num_scheduled; i++) {
+        const Interval *interval = &interval_list->intervals[i];
+        if((counter % interval->time) == interval->offset) {
+            queue_event(interval_list, i, counter);
+        }
+    }
+#endif
+}
+
+#if (INTERVAL_TICKLESS)
+static uint64_t period_ticks(const Interval *interval)
+{
+    return delay_us_to_ticks(interval->time);
+}
+
+void interval_update(IntervalList *interval_list)
+{
+    interval_update_at(interval_list, delay_get_timestamp());
+}
+
+void interval_update_at(IntervalList *interval_list, uint64_t now)
+{
+    if(!interval_list->tickless) {
+        return;
+    }
+
+    while(interval_list->num_scheduled < interval_list->num_intervals) {
+        const int i = interval_list->num_scheduled;
+        const Interval *interval = &interval_list->intervals[i];
+        deadline_heap_set(&interval_list->heap, i,
+                now + period_ticks(interval) + delay_us_to_ticks(interval->offset));
+        interval_list->num_scheduled += 1;
+    }
+
+    uint64_t due;
+    uint16_t i;
+    while((i = deadline_heap_peek(&interval_list->heap, &due))
+            != DEADLINE_HEAP_NONE) {
+        if(due > now) {
+            break;
         }
+        Interval *interval = &interval_list->intervals[i];
+        queue_event(interval_list, i, due);
+
+        // Keep the phase. Skip whole intervals that were missed.
+        const uint64_t period = period_ticks(interval);
+        uint64_t next = due + period;
+        if(next <= now) {
+            const uint64_t skipped = ((now - next) / period) + 1;
+            interval->missed += skipped;
+            next+= skipped * period;
+        }
+        deadline_heap_set(&interval_list->heap, i, next);
+    }
+}
+
+bool interval_next_deadline(IntervalList *interval_list, uint64_t *deadline)
+{
+    if(interval_list->num_scheduled < interval_list->num_intervals) {
+        *deadline = 0;
+        return true;
     }
+    return (deadline_heap_peek(&interval_list->heap, deadline)
+            != DEADLINE_HEAP_NONE);
 }
+#endif
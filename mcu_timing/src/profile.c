@@ -1,58 +1,238 @@
 #include "profile.h"
+#include "profile_trace.h"
+#include "profile_calltree.h"
 #include "delay.h"
 
-static Profile *profile_list[MAX_PROFILES];
-static int num_profiles = 0;
+#define PROFILE_PASTE_(a, b) a ## b
+#define PROFILE_PASTE(a, b) PROFILE_PASTE_(a, b)
+
+// Generated by the linker (or the linker script), see profile.h.
+// Weak, so they are NULL if there are no profiles at all
+extern Profile PROFILE_PASTE(__start_, PROFILE_SECTION)[] __attribute__((weak));
+extern Profile PROFILE_PASTE(__stop_, PROFILE_SECTION)[] __attribute__((weak));
+
+#define PROFILE_LIST_START  (PROFILE_PASTE(__start_, PROFILE_SECTION))
+#define PROFILE_LIST_STOP   (PROFILE_PASTE(__stop_, PROFILE_SECTION))
+
+/**
+ * overhead         Overhead in ticks as measured by profile_calibrate()
+ * compensation     Overhead subtracted from each duration: either 0 or
+ *                  'overhead', depending on profile_set_compensation()
+ */
+static struct {
+    uint64_t overhead;
+    uint64_t compensation;
+} g_calibration;
+
+#if (PROFILE_HISTOGRAM)
+
+#define SUB_BUCKETS     (1UL << PROFILE_HISTOGRAM_SUB_BITS)
+#define MAX_VALUE       ((1UL << PROFILE_HISTOGRAM_MAX_BITS) - 1)
+
+/*
+ * Values below SUB_BUCKETS get a bucket each. Above that, the bucket is
+ * selected by the position of the most significant bit (count leading zeros)
+ * and the PROFILE_HISTOGRAM_SUB_BITS bits below it.
+ */
+static uint32_t histogram_index(uint64_t ticks)
+{
+    const uint32_t value = (ticks > MAX_VALUE) ? MAX_VALUE : ticks;
+    if(value < SUB_BUCKETS) {
+        return value;
+    }
+
+    const uint32_t msb = 31 - __builtin_clz(value);
+    const uint32_t shift = msb - PROFILE_HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << PROFILE_HISTOGRAM_SUB_BITS)
+        + ((value >> shift) - SUB_BUCKETS);
+}
+
+// Highest value that is counted in a bucket
+static uint64_t histogram_upper_bound(uint32_t index)
+{
+    if(index < SUB_BUCKETS) {
+        return index;
+    }
+
+    const uint32_t shift = (index >> PROFILE_HISTOGRAM_SUB_BITS) - 1;
+    const uint64_t sub = index & (SUB_BUCKETS - 1);
+    return (((SUB_BUCKETS + sub + 1) << shift) - 1);
+}
+
+uint64_t profile_get_percentile(Profile *prof, unsigned int permille)
+{
+    uint64_t total = 0;
+    for(int i=0; i < PROFILE_HISTOGRAM_BUCKETS; i++) {
+        total+= prof->histogram[i];
+    }
+    if(!total) {
+        return 0;
+    }
+
+    if(permille > 1000) {
+        permille = 1000;
+    }
+    uint64_t rank = ((total * permille) + 999) / 1000;
+    if(!rank) {
+        rank = 1;
+    }
+
+    uint64_t count = 0;
+    for(int i=0; i < PROFILE_HISTOGRAM_BUCKETS; i++) {
+        count+= prof->histogram[i];
+        // The last bucket also holds everything above its range
+        if((count >= rank) && (i < (PROFILE_HISTOGRAM_BUCKETS - 1))) {
+            const uint64_t upper = histogram_upper_bound(i);
+            return (upper < prof->max_ticks) ? upper : prof->max_ticks;
+        }
+    }
+    return prof->max_ticks;
+}
+
+#endif
 
 void profile_init(Profile *prof, const char *label, uint64_t threshold)
 {
     profile_reset(prof);
     prof->label = label;
     prof->threshold = threshold;
-
-    if (num_profiles < MAX_PROFILES) {
-        profile_list[num_profiles++] = prof;
-    }
+    prof->sample_rate = 0;
+    prof->sample_random = false;
+    prof->sample_countdown = 0;
 }
 
 void profile_reset(Profile *prof) 
 {
     prof->call_count = 0;
+    prof->sample_count = 0;
+    prof->sample_countdown = 0;
     prof->threshold_call_count = 0;
     prof->ticks = 0;
     prof->max_ticks = 0;
     prof->timestamp = 0;
+
+#if (PROFILE_HISTOGRAM)
+    for(int i=0; i < PROFILE_HISTOGRAM_BUCKETS; i++) {
+        prof->histogram[i] = 0;
+    }
+#endif
+}
+
+// Amount of calls to skip before the next timed call
+static uint16_t sample_interval(Profile *prof)
+{
+    if(!prof->sample_random) {
+        return prof->sample_rate - 1;
+    }
+
+    // Galois LFSR: races between interrupts only make it more random
+    static uint32_t lfsr = 0xACE1ACE1;
+    uint32_t x = lfsr;
+    x = (x >> 1) ^ ((-(x & 1U)) & 0x80200003UL);
+    lfsr = x;
+
+    // uniform in 0..2*(rate-1), without a division
+    const uint32_t range = (2 * (uint32_t)prof->sample_rate) - 1;
+    return ((x & 0xFFFF) * range) >> 16;
+}
+
+void profile_set_sampling(Profile *prof, uint16_t rate, bool random)
+{
+    if(rate > PROFILE_MAX_SAMPLE_RATE) {
+        rate = PROFILE_MAX_SAMPLE_RATE;
+    }
+    prof->sample_rate = rate;
+    prof->sample_random = random;
+    prof->sample_countdown = 0;
+}
+
+// Returns false if this call is skipped by sampling
+static bool start_sample(Profile *prof)
+{
+    if(prof->sample_countdown) {
+        prof->sample_countdown--;
+        prof->call_count++;
+        return false;
+    }
+    if(prof->sample_rate > 1) {
+        prof->sample_countdown = sample_interval(prof);
+    }
+
+#if (PROFILE_CALLTREE)
+    // Outside the measured time: the call tree is not part of the overhead
+    profile_calltree_enter(prof);
+#endif
+    return true;
+}
+
+static void start_trace(Profile *prof)
+{
+#if (PROFILE_TRACE)
+    profile_trace_event(profile_get_index(prof), false, prof->timestamp);
+#endif
 }
 
 void profile_start(Profile *prof)
 {
-    prof->timestamp = delay_get_timestamp();
+    if(start_sample(prof)) {
+        prof->timestamp = delay_get_timestamp();
+        start_trace(prof);
+    }
+}
+
+void profile_start_at(Profile *prof, uint64_t now)
+{
+    if(start_sample(prof)) {
+        prof->timestamp = now;
+        start_trace(prof);
+    }
 }
 
 void profile_end(Profile *prof)
+{
+    if(!prof->timestamp) {
+        return;
+    }
+    profile_end_at(prof, delay_get_timestamp());
+}
+
+void profile_end_at(Profile *prof, uint64_t end)
 {
     if(!prof->timestamp) {
         return;
     }
 
-    uint64_t end = delay_get_timestamp();
-    uint64_t d = end - prof->timestamp;
+    uint64_t d = (end > prof->timestamp) ? (end - prof->timestamp) : 0;
+#if (PROFILE_TRACE)
+    profile_trace_event(profile_get_index(prof), true, end);
+#endif
+    d = (d > g_calibration.compensation) ? (d - g_calibration.compensation) : 0;
     
     if(d > prof->max_ticks) {
         prof->max_ticks = d;
     }
     prof->ticks+= d;
     prof->call_count++;
+    prof->sample_count++;
     
     if(prof->threshold && (d > prof->threshold)) {
         prof->threshold_call_count++;
     }
+#if (PROFILE_HISTOGRAM)
+    prof->histogram[histogram_index(d)]++;
+#endif
     prof->timestamp = 0;
+#if (PROFILE_CALLTREE)
+    profile_calltree_exit(prof, d);
+#endif
 }
 
 uint64_t profile_get_average(Profile *prof)
 {
-    return (prof->ticks / prof->call_count);
+    if(!prof->sample_count) {
+        return 0;
+    }
+    return (prof->ticks / prof->sample_count);
 }
 
 uint64_t profile_get_max(Profile *prof)
@@ -67,7 +247,49 @@ uint64_t profile_get_total_call_count(Profile *prof)
 
 uint64_t profile_get_threshold_count(Profile *prof)
 {
-    return prof->threshold_call_count;
+    if(!prof->sample_count || (prof->sample_count == prof->call_count)) {
+        return prof->threshold_call_count;
+    }
+    return (prof->threshold_call_count * prof->call_count) / prof->sample_count;
+}
+
+uint64_t profile_calibrate(void)
+{
+    g_calibration.compensation = 0;
+
+    Profile prof;
+    profile_init(&prof, "calibration", 0);
+
+    uint64_t overhead = UINT64_MAX;
+    for(int i=0; i < PROFILE_CALIBRATION_RUNS; i++) {
+        profile_reset(&prof);
+        profile_start(&prof);
+        profile_end(&prof);
+        if(prof.call_count && (prof.ticks < overhead)) {
+            overhead = prof.ticks;
+        }
+    }
+    if(overhead == UINT64_MAX) {
+        overhead = 0;
+    }
+
+#if (PROFILE_CALLTREE)
+    profile_calltree_reset();
+#endif
+
+    g_calibration.overhead = overhead;
+    g_calibration.compensation = overhead;
+    return overhead;
+}
+
+void profile_set_compensation(bool enable)
+{
+    g_calibration.compensation = enable ? g_calibration.overhead : 0;
+}
+
+uint64_t profile_get_overhead(void)
+{
+    return g_calibration.overhead;
 }
 
 
@@ -78,12 +300,20 @@ void profile_end_ptr(Profile **prof)
 
 int profile_list_size(void)
 {
-    return num_profiles;
+    return PROFILE_LIST_STOP - PROFILE_LIST_START;
 }
 
-int profile_get_data(Profile **list[MAX_PROFILES])
+int profile_get_data(Profile **list)
 {
-    *list = (profile_list);
+    *list = PROFILE_LIST_START;
     return profile_list_size();
 }
 
+int profile_get_index(const Profile *prof)
+{
+    if((prof < PROFILE_LIST_START) || (prof >= PROFILE_LIST_STOP)) {
+        return -1;
+    }
+    return prof - PROFILE_LIST_START;
+}
+
@@ -0,0 +1,292 @@
+#include "profile_calltree.h"
+#include "atomic_u32.h"
+#include <string.h>
+
+#if (PROFILE_CALLTREE)
+
+// Not a node (PROFILE_CALLTREE_ROOT is 0xFFFF)
+#define NODE_NONE       (0xFFFE)
+
+// Node lookup by (parent, profile): hash buckets with chaining through
+// ProfileCallTreeNode.next. Buckets and 'next' hold node index + 1 (0 ends
+// the chain), so the zero initialized table is empty.
+#define NUM_BUCKETS     (PROFILE_CALLTREE_NODES)
+
+/**
+ * An active profile. A frame without a node (node == NODE_NONE) keeps the
+ * stack balanced, but is not recorded.
+ */
+typedef struct {
+    const Profile *prof;
+    uint16_t node;
+    uint64_t child_ticks;
+} Frame;
+
+/**
+ * Each context is only modified from that context. In the handler context,
+ * nested interrupts share the stack and the node counters: a higher
+ * priority interrupt can preempt an update. So every enter / exit runs with
+ * interrupts masked (see lock()). Nodes are still reserved and linked in
+ * with atomic operations, so the tree can be read at any time.
+ * The stack may be deeper than PROFILE_CALLTREE_DEPTH: those frames are not
+ * stored, only counted in 'depth'.
+ */
+typedef struct {
+    Frame stack[PROFILE_CALLTREE_DEPTH];
+    int depth;
+
+    ProfileCallTreeNode nodes[PROFILE_CALLTREE_NODES];
+    volatile uint32_t num_nodes;    // may exceed PROFILE_CALLTREE_NODES
+    volatile uint32_t buckets[NUM_BUCKETS];
+} Context;
+
+static Context g_contexts[PROFILE_CALLTREE_CONTEXTS];
+static volatile uint32_t g_dropped;
+
+
+// Mask interrupts, returns the previous state for unlock()
+static inline uint32_t lock(void)
+{
+#if defined(__arm__)
+    uint32_t primask;
+    __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+    return primask;
+#else
+    return 0;
+#endif
+}
+
+static inline void unlock(uint32_t primask)
+{
+#if defined(__arm__)
+    __asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+#else
+    (void)primask;
+#endif
+}
+
+static Context *current_context(void)
+{
+#if defined(__arm__)
+    uint32_t ipsr;
+    __asm volatile ("mrs %0, ipsr" : "=r" (ipsr));
+    if(ipsr) {
+        return &g_contexts[PROFILE_CALLTREE_HANDLER];
+    }
+#endif
+    return &g_contexts[PROFILE_CALLTREE_THREAD];
+}
+
+static uint32_t bucket_index(const Profile *prof, uint16_t parent)
+{
+    const uint32_t key = ((uint32_t)(uintptr_t)prof) ^ (((uint32_t)parent) << 16);
+    const uint32_t hash = key * 0x9E3779B1UL;
+    return (hash >> 16) % NUM_BUCKETS;
+}
+
+static uint16_t count_nodes(const Context *context)
+{
+    const uint32_t count = context->num_nodes;
+    return (count < PROFILE_CALLTREE_NODES) ? count : PROFILE_CALLTREE_NODES;
+}
+
+// Find or create the node for 'prof' called from 'parent'
+static uint16_t lookup_node(Context *context, const Profile *prof,
+        uint16_t parent)
+{
+    volatile uint32_t *bucket = &context->buckets[bucket_index(prof, parent)];
+
+    uint32_t head = atomic_u32_load(bucket);
+    for(uint32_t i = head; i; i = context->nodes[i - 1].next) {
+        const ProfileCallTreeNode *node = &context->nodes[i - 1];
+        if((node->prof == prof) && (node->parent == parent)) {
+            return i - 1;
+        }
+    }
+
+    const uint32_t i = atomic_u32_fetch_add(&context->num_nodes, 1);
+    if(i >= PROFILE_CALLTREE_NODES) {
+        return NODE_NONE;
+    }
+    ProfileCallTreeNode *node = &context->nodes[i];
+    node->parent = parent;
+    node->call_count = 0;
+    node->inclusive_ticks = 0;
+    node->self_ticks = 0;
+    node->prof = prof;
+
+    // If a nested interrupt created the same node in the meantime, there are
+    // two nodes for the same path. That is harmless: folded stacks are summed.
+    do {
+        node->next = head;
+    } while(!atomic_u32_cas(bucket, &head, i + 1));
+    return i;
+}
+
+static void enter(Context *context, const Profile *prof)
+{
+    const int depth = context->depth;
+    if(depth >= PROFILE_CALLTREE_DEPTH) {
+        context->depth = depth + 1;
+        g_dropped++;
+        return;
+    }
+
+    uint16_t node = NODE_NONE;
+    const uint16_t parent = depth
+        ? context->stack[depth - 1].node : PROFILE_CALLTREE_ROOT;
+
+    // Children of a dropped frame are dropped as well: they can not be
+    // attributed to the right path
+    if(parent != NODE_NONE) {
+        node = lookup_node(context, prof, parent);
+    }
+    if(node == NODE_NONE) {
+        g_dropped++;
+    }
+
+    Frame *frame = &context->stack[depth];
+    frame->prof = prof;
+    frame->node = node;
+    frame->child_ticks = 0;
+    context->depth = depth + 1;
+}
+
+void profile_calltree_enter(const Profile *prof)
+{
+    Context *context = current_context();
+    const uint32_t primask = lock();
+    enter(context, prof);
+    unlock(primask);
+}
+
+static void exit_frame(Context *context, const Profile *prof, uint64_t ticks)
+{
+    if(context->depth > PROFILE_CALLTREE_DEPTH) {
+        context->depth--;
+        return;
+    }
+
+    // Find the frame of this profile. Frames above it did not end properly
+    int depth = context->depth;
+    while(depth && (context->stack[depth - 1].prof != prof)) {
+        depth--;
+    }
+    if(!depth) {
+        return;
+    }
+    depth--;
+
+    const Frame *frame = &context->stack[depth];
+    if(frame->node != NODE_NONE) {
+        ProfileCallTreeNode *node = &context->nodes[frame->node];
+        node->call_count++;
+        node->inclusive_ticks+= ticks;
+        node->self_ticks+= (ticks > frame->child_ticks)
+            ? (ticks - frame->child_ticks) : 0;
+    }
+    if(depth) {
+        context->stack[depth - 1].child_ticks+= ticks;
+    }
+    context->depth = depth;
+}
+
+void profile_calltree_exit(const Profile *prof, uint64_t ticks)
+{
+    Context *context = current_context();
+    const uint32_t primask = lock();
+    exit_frame(context, prof, ticks);
+    unlock(primask);
+}
+
+void profile_calltree_reset(void)
+{
+    for(int c=0; c < PROFILE_CALLTREE_CONTEXTS; c++) {
+        Context *context = &g_contexts[c];
+        context->depth = 0;
+        context->num_nodes = 0;
+        for(int i=0; i < NUM_BUCKETS; i++) {
+            context->buckets[i] = 0;
+        }
+        for(int i=0; i < PROFILE_CALLTREE_NODES; i++) {
+            context->nodes[i].prof = NULL;
+        }
+    }
+    g_dropped = 0;
+}
+
+int profile_calltree_get_nodes(int context, const ProfileCallTreeNode **nodes)
+{
+    if((context < 0) || (context >= PROFILE_CALLTREE_CONTEXTS)) {
+        *nodes = NULL;
+        return 0;
+    }
+    *nodes = g_contexts[context].nodes;
+    return count_nodes(&g_contexts[context]);
+}
+
+uint32_t profile_calltree_get_dropped(void)
+{
+    return g_dropped;
+}
+
+
+static void sink_string(ProfileSink sink, void *ctx, const char *str)
+{
+    sink(ctx, str, strlen(str));
+}
+
+static void sink_u64(ProfileSink sink, void *ctx, uint64_t value)
+{
+    char buffer[20];
+    int i = sizeof(buffer);
+    do {
+        buffer[--i] = '0' + (value % 10);
+        value/= 10;
+    } while(value);
+    sink(ctx, &buffer[i], sizeof(buffer) - i);
+}
+
+static void dump_path(ProfileSink sink, void *ctx,
+        const ProfileCallTreeNode *nodes, uint16_t index)
+{
+    // Collect the path leaf-first, then write it root-first
+    uint16_t path[PROFILE_CALLTREE_DEPTH];
+    int length = 0;
+    while((index != PROFILE_CALLTREE_ROOT)
+            && (length < PROFILE_CALLTREE_DEPTH)) {
+        path[length++] = index;
+        index = nodes[index].parent;
+    }
+
+    while(length--) {
+        const char *label = nodes[path[length]].prof->label;
+        sink_string(sink, ctx, label ? label : "?");
+        if(length) {
+            sink_string(sink, ctx, ";");
+        }
+    }
+}
+
+void profile_calltree_dump_folded(ProfileSink sink, void *ctx)
+{
+    for(int c=0; c < PROFILE_CALLTREE_CONTEXTS; c++) {
+        const Context *context = &g_contexts[c];
+        const uint16_t num_nodes = count_nodes(context);
+        for(uint16_t i=0; i < num_nodes; i++) {
+            // Skip a node that is being created right now
+            if(!context->nodes[i].prof) {
+                continue;
+            }
+            if(c == PROFILE_CALLTREE_HANDLER) {
+                sink_string(sink, ctx, "irq;");
+            }
+            dump_path(sink, ctx, context->nodes, i);
+            sink_string(sink, ctx, " ");
+            sink_u64(sink, ctx, context->nodes[i].self_ticks);
+            sink_string(sink, ctx, "\n");
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include "profile_trace.h"
+#include "profile.h"
+#include "atomic_u32.h"
+#include "delay.h"
+#include <string.h>
+
+#if (PROFILE_TRACE)
+
+#define TIME_MASK       ((1UL << PROFILE_TRACE_TIME_BITS) - 1)
+
+// A sync record holds the next timestamp bits in all bits below the index
+#define SYNC_MASK       ((1UL << PROFILE_TRACE_INDEX_SHIFT) - 1)
+
+// Insert a sync record at least this often...
+#define SYNC_INTERVAL   (PROFILE_TRACE_SIZE / 4)
+
+// ...and whenever the time since the last record is too large to recover
+// from the low timestamp bits (with a safety margin)
+#define SYNC_MAX_DELTA  (1UL << (PROFILE_TRACE_TIME_BITS - 2))
+
+/**
+ * head             Total amount of records ever reserved. The record for
+ *                  head N is stored at records[N % PROFILE_TRACE_SIZE].
+ *
+ * last_timestamp,  Only used to decide when a sync record is needed. These
+ * last_sync        are updated without synchronization: a race only causes
+ *                  an extra sync record. The initial value of last_sync
+ *                  forces a sync record at the start of the trace.
+ */
+static struct {
+    uint32_t records[PROFILE_TRACE_SIZE];
+    volatile uint32_t head;
+    volatile bool enabled;
+
+    volatile uint64_t last_timestamp;
+    volatile uint32_t last_sync;
+} g_trace = {
+    .enabled = true,
+    .last_sync = -SYNC_INTERVAL,
+};
+
+static uint32_t make_record(uint32_t index, uint32_t flags, uint32_t time)
+{
+    return (index << PROFILE_TRACE_INDEX_SHIFT) | flags | (time & TIME_MASK);
+}
+
+static uint32_t make_sync_record(uint64_t timestamp)
+{
+    return (PROFILE_TRACE_SYNC << PROFILE_TRACE_INDEX_SHIFT)
+        | ((timestamp >> PROFILE_TRACE_TIME_BITS) & SYNC_MASK);
+}
+
+void profile_trace_event(uint16_t index, bool end, uint64_t timestamp)
+{
+    if(!g_trace.enabled) {
+        return;
+    }
+    if(index > PROFILE_TRACE_UNKNOWN) {
+        index = PROFILE_TRACE_UNKNOWN;
+    }
+
+    const bool sync = ((timestamp - g_trace.last_timestamp) >= SYNC_MAX_DELTA)
+        || ((g_trace.head - g_trace.last_sync) >= SYNC_INTERVAL);
+
+    // Reserve space first: an irq may add records in between,
+    // but can never write to the same slot
+    uint32_t slot = atomic_u32_fetch_add(&g_trace.head, sync ? 2 : 1);
+
+    if(sync) {
+        g_trace.records[slot % PROFILE_TRACE_SIZE] =
+            make_sync_record(timestamp);
+        g_trace.last_sync = slot;
+        slot++;
+    }
+    g_trace.records[slot % PROFILE_TRACE_SIZE] = make_record(index,
+            end ? PROFILE_TRACE_END_BIT : 0, timestamp);
+    g_trace.last_timestamp = timestamp;
+}
+
+void profile_trace_enable(bool enable)
+{
+    g_trace.enabled = enable;
+}
+
+void profile_trace_clear(void)
+{
+    g_trace.head = 0;
+    g_trace.last_sync = -SYNC_INTERVAL;
+    g_trace.last_timestamp = 0;
+}
+
+void profile_trace_dump(ProfileSink sink, void *ctx)
+{
+    Profile *list;
+    const int num_labels = profile_get_data(&list);
+
+    const uint32_t head = atomic_u32_load(&g_trace.head);
+    const uint32_t num_records = (head < PROFILE_TRACE_SIZE)
+        ? head : PROFILE_TRACE_SIZE;
+
+    const ProfileTraceHeader header = {
+        .magic = PROFILE_TRACE_MAGIC,
+        .version = PROFILE_TRACE_VERSION,
+        .reserved = 0,
+        .ticks_per_second = delay_get_tick_rate(),
+        .num_records = num_records,
+        .num_labels = num_labels,
+    };
+    sink(ctx, &header, sizeof(header));
+
+    // Oldest record first: the buffer wraps at most once
+    const uint32_t start = (head - num_records) % PROFILE_TRACE_SIZE;
+    const uint32_t first_chunk = PROFILE_TRACE_SIZE - start;
+    if(num_records <= first_chunk) {
+        sink(ctx, &g_trace.records[start], num_records * sizeof(uint32_t));
+    } else {
+        sink(ctx, &g_trace.records[start], first_chunk * sizeof(uint32_t));
+        sink(ctx, &g_trace.records[0],
+                (num_records - first_chunk) * sizeof(uint32_t));
+    }
+
+    for(int i=0; i < num_labels; i++) {
+        const char *label = list[i].label ? list[i].label : "";
+        const uint16_t length = strlen(label);
+        sink(ctx, &length, sizeof(length));
+        sink(ctx, label, length);
+    }
+}
+
+#endif
@@ -18,13 +18,18 @@ void rate_limit_init(RateLimit *limit, uint64_t min_delay, uint64_t max_delay,
 
 bool rate_limit_allowed(RateLimit *limit)
 {
-    if(!delay_timeout_done(&limit->treshold_timeout)) {
+    return rate_limit_allowed_at(limit, delay_get_timestamp());
+}
+
+bool rate_limit_allowed_at(RateLimit *limit, uint64_t now)
+{
+    if(!delay_timeout_done_at(&limit->treshold_timeout, now)) {
         if(!limit->increase) {
             limit->increase = true;
         }
     }
     // waited long enough
-    if(delay_timeout_done(&limit->timeout)) {
+    if(delay_timeout_done_at(&limit->timeout, now)) {
         uint64_t delay = limit->delay;
         if(limit->increase) {
             limit->increase = false;
@@ -44,8 +49,9 @@ bool rate_limit_allowed(RateLimit *limit)
         }
         limit->delay = delay;
 
-        delay_timeout_set(&limit->timeout, limit->delay);
-        delay_timeout_set(&limit->treshold_timeout, limit->treshold_delay);
+        delay_timeout_set_at(&limit->timeout, now, limit->delay);
+        delay_timeout_set_at(&limit->treshold_timeout, now,
+                limit->treshold_delay);
         return true;
     }
 
@@ -0,0 +1,86 @@
+#include "timeout_set.h"
+#include "delay.h"
+
+#if (TIMEOUT_SET_MAX > 0xFFFE)
+    #error TIMEOUT_SET_MAX should be 0xFFFE or less
+#endif
+
+void timeout_set_init(TimeoutSet *set)
+{
+    deadline_heap_init(&set->heap, set->nodes, set->positions,
+            TIMEOUT_SET_MAX);
+}
+
+bool timeout_set_arm(TimeoutSet *set, uint16_t id, uint64_t microseconds)
+{
+    return timeout_set_arm_at(set, id, delay_get_timestamp(), microseconds);
+}
+
+bool timeout_set_arm_at(TimeoutSet *set, uint16_t id, uint64_t now,
+        uint64_t microseconds)
+{
+    return timeout_set_arm_slack_at(set, id, now, microseconds, 0);
+}
+
+bool timeout_set_arm_slack_at(TimeoutSet *set, uint16_t id, uint64_t now,
+        uint64_t microseconds, uint64_t slack_us)
+{
+    if(id >= TIMEOUT_SET_MAX) {
+        return false;
+    }
+
+    // Same target as a delay_timeout_t would get
+    delay_timeout_t timeout;
+    delay_timeout_set_at(&timeout, now, microseconds);
+
+    set->slack[id] = delay_us_to_ticks(slack_us);
+    return deadline_heap_set(&set->heap, id, timeout.target_timestamp);
+}
+
+bool timeout_set_cancel(TimeoutSet *set, uint16_t id)
+{
+    return deadline_heap_remove(&set->heap, id);
+}
+
+bool timeout_set_is_armed(const TimeoutSet *set, uint16_t id)
+{
+    return deadline_heap_contains(&set->heap, id);
+}
+
+uint16_t timeout_set_expired(TimeoutSet *set, uint16_t *ids, uint16_t max_ids)
+{
+    return timeout_set_expired_at(set, delay_get_timestamp(), ids, max_ids);
+}
+
+uint16_t timeout_set_expired_at(TimeoutSet *set, uint64_t now,
+        uint16_t *ids, uint16_t max_ids)
+{
+    uint16_t count = 0;
+    while(count < max_ids) {
+        const uint16_t id = deadline_heap_pop_expired(&set->heap, now);
+        if(id == DEADLINE_HEAP_NONE) {
+            break;
+        }
+        ids[count++] = id;
+    }
+    return count;
+}
+
+uint16_t timeout_set_next_expiry(const TimeoutSet *set, uint64_t *timestamp)
+{
+    return deadline_heap_peek(&set->heap, timestamp);
+}
+
+bool timeout_set_next_wakeup(const TimeoutSet *set, uint64_t *timestamp)
+{
+    return deadline_heap_peek_latest(&set->heap, set->slack, timestamp);
+}
+
+uint64_t timeout_set_next_expiry_us(const TimeoutSet *set)
+{
+    uint64_t target;
+    if(deadline_heap_peek(&set->heap, &target) == DEADLINE_HEAP_NONE) {
+        return UINT64_MAX;
+    }
+    return delay_calc_time_us(delay_get_timestamp(), target);
+}
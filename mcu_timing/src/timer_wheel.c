@@ -0,0 +1,164 @@
+#include "timer_wheel.h"
+
+#define SLOT_MASK       (TIMER_WHEEL_SLOTS - 1)
+
+// 'slot' value for entries in the expired list
+#define EXPIRED_SLOT    (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+
+/*
+ * Each entry is stored in exactly one doubly linked list: either one of the
+ * wheel slots or the 'expired' list. Lists are linked by index, the entry
+ * remembers which list it is in so it can be unlinked in O(1).
+ *
+ * Level 0 has one slot per tick. A slot in level N covers
+ * 2^(N*TIMER_WHEEL_SLOT_BITS) ticks. When the lower levels wrap around,
+ * the matching slot of the next level is 'cascaded': its entries are
+ * re-inserted, which moves them to a lower level.
+ */
+
+static uint16_t *list_head(TimerWheel *wheel, uint16_t slot)
+{
+    if(slot == EXPIRED_SLOT) {
+        return &wheel->expired;
+    }
+    return &wheel->slots[slot];
+}
+
+static void link(TimerWheel *wheel, uint16_t index, uint16_t slot)
+{
+    TimerWheelEntry *entry = &wheel->entries[index];
+    uint16_t *head = list_head(wheel, slot);
+
+    entry->slot = slot;
+    entry->prev = TIMER_WHEEL_NONE;
+    entry->next = *head;
+    if(*head != TIMER_WHEEL_NONE) {
+        wheel->entries[*head].prev = index;
+    }
+    *head = index;
+}
+
+static void unlink(TimerWheel *wheel, uint16_t index)
+{
+    TimerWheelEntry *entry = &wheel->entries[index];
+
+    if(entry->prev != TIMER_WHEEL_NONE) {
+        wheel->entries[entry->prev].next = entry->next;
+    } else {
+        *list_head(wheel, entry->slot) = entry->next;
+    }
+    if(entry->next != TIMER_WHEEL_NONE) {
+        wheel->entries[entry->next].prev = entry->prev;
+    }
+    entry->slot = TIMER_WHEEL_NONE;
+}
+
+static void insert(TimerWheel *wheel, uint16_t index)
+{
+    const uint32_t expires = wheel->entries[index].expires;
+    const uint32_t delta = expires - wheel->now;
+
+    // Find the lowest level that can hold this delta
+    int level = 0;
+    while((level < (TIMER_WHEEL_LEVELS-1))
+            && (delta >> ((level+1) * TIMER_WHEEL_SLOT_BITS))) {
+        level++;
+    }
+
+    const uint32_t slot = (expires >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    link(wheel, index, (level * TIMER_WHEEL_SLOTS) + slot);
+}
+
+static void cascade(TimerWheel *wheel, int level)
+{
+    const uint32_t slot = (wheel->now >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    uint16_t *head = &wheel->slots[(level * TIMER_WHEEL_SLOTS) + slot];
+
+    uint16_t index = *head;
+    *head = TIMER_WHEEL_NONE;
+
+    while(index != TIMER_WHEEL_NONE) {
+        const uint16_t next = wheel->entries[index].next;
+        insert(wheel, index);
+        index = next;
+    }
+}
+
+void timer_wheel_init(TimerWheel *wheel, TimerWheelEntry *entries,
+        uint16_t num_entries, uint32_t now)
+{
+    wheel->entries = entries;
+    wheel->num_entries = num_entries;
+    wheel->expired = TIMER_WHEEL_NONE;
+    wheel->now = now;
+
+    for(int i=0; i < (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS); i++) {
+        wheel->slots[i] = TIMER_WHEEL_NONE;
+    }
+    for(int i=0; i < num_entries; i++) {
+        entries[i].slot = TIMER_WHEEL_NONE;
+    }
+}
+
+bool timer_wheel_add(TimerWheel *wheel, uint16_t index, uint32_t ticks)
+{
+    if(index >= wheel->num_entries) {
+        return false;
+    }
+    timer_wheel_cancel(wheel, index);
+
+    // A timer that expires 'now' would never be reached: that tick
+    // is already processed.
+    if(!ticks) {
+        ticks = 1;
+    }
+    wheel->entries[index].expires = wheel->now + ticks;
+    insert(wheel, index);
+    return true;
+}
+
+void timer_wheel_cancel(TimerWheel *wheel, uint16_t index)
+{
+    if(timer_wheel_is_armed(wheel, index)) {
+        unlink(wheel, index);
+    }
+}
+
+bool timer_wheel_is_armed(TimerWheel *wheel, uint16_t index)
+{
+    return (index < wheel->num_entries)
+        && (wheel->entries[index].slot != TIMER_WHEEL_NONE);
+}
+
+void timer_wheel_tick(TimerWheel *wheel)
+{
+    wheel->now++;
+
+    // Cascade higher levels when all lower levels have wrapped around
+    for(int level=1; level < TIMER_WHEEL_LEVELS; level++) {
+        if(wheel->now & ((1UL << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) {
+            break;
+        }
+        cascade(wheel, level);
+    }
+
+    // Everything in the current level 0 slot expires now
+    uint16_t *head = &wheel->slots[wheel->now & SLOT_MASK];
+    uint16_t index = *head;
+    *head = TIMER_WHEEL_NONE;
+
+    while(index != TIMER_WHEEL_NONE) {
+        const uint16_t next = wheel->entries[index].next;
+        link(wheel, index, EXPIRED_SLOT);
+        index = next;
+    }
+}
+
+uint16_t timer_wheel_pop_expired(TimerWheel *wheel)
+{
+    const uint16_t index = wheel->expired;
+    if(index != TIMER_WHEEL_NONE) {
+        unlink(wheel, index);
+    }
+    return index;
+}
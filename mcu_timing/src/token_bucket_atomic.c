@@ -0,0 +1,102 @@
+#include "token_bucket_atomic.h"
+#include "atomic_u32.h"
+#include "delay.h"
+#include <stddef.h>
+
+// A timestamp in units of 1/num_req_per_interval microseconds, modulo 2^32
+static uint32_t now_units(const TokenBucketAtomic *limiter, uint64_t now)
+{
+    const uint32_t now_us = delay_calc_time_us(0, now);
+    return now_us * limiter->num_req_per_interval;
+}
+
+bool token_bucket_atomic_init(TokenBucketAtomic *limiter,
+        unsigned int max_requests,
+        unsigned int interval_us,
+        unsigned int max_burst)
+{
+    const uint64_t limit = ((uint64_t)max_burst) * interval_us;
+    if(!max_requests || !limit || (limit >= (1UL << 31))) {
+        return false;
+    }
+
+    limiter->emission_interval = interval_us;
+    limiter->limit = limit;
+    limiter->num_req_per_interval = max_requests;
+    limiter->max_tokens = max_burst;
+    limiter->tat = now_units(limiter, delay_get_timestamp());
+    return true;
+}
+
+// How far the TAT is ahead of 'now'. A TAT in the past (which wraps to
+// 2^31 or more) means the bucket is full.
+// Between the limit and 2^31, the TAT is either a stale TAT from a long idle
+// time (the bucket is full), or it was set with a later time than 'now'.
+// The latter is only possible if 'timestamp' was passed by the caller (e.g.
+// it was preempted after reading the time): the current time tells which
+// case it is. Returns false if 'now' is outdated.
+static bool get_ahead(const TokenBucketAtomic *limiter, uint32_t tat,
+        uint32_t now, const uint64_t *timestamp, uint32_t *ahead)
+{
+    *ahead = tat - now;
+    if(*ahead <= limiter->limit) {
+        return true;
+    }
+    *ahead = 0;
+    if(timestamp) {
+        const uint32_t current = now_units(limiter, delay_get_timestamp());
+        return ((uint32_t)(tat - current) > limiter->limit);
+    }
+    return true;
+}
+
+// If 'timestamp' is NULL, the time is read after every load of the TAT
+static bool allowed(TokenBucketAtomic *limiter, unsigned int num_events,
+        const uint64_t *timestamp)
+{
+    if(num_events > limiter->max_tokens) {
+        return false;
+    }
+    const uint32_t cost = num_events * limiter->emission_interval;
+
+    uint32_t tat = atomic_u32_load(&limiter->tat);
+    while(1) {
+        const uint32_t now = now_units(limiter,
+                timestamp ? *timestamp : delay_get_timestamp());
+
+        uint32_t ahead;
+        if(!get_ahead(limiter, tat, now, timestamp, &ahead)) {
+            return false;
+        }
+        if((limiter->limit - ahead) < cost) {
+            return false;
+        }
+        // On failure, 'tat' is updated with the current value (possibly set
+        // with a later time than 'now'): try again
+        if(atomic_u32_cas(&limiter->tat, &tat, now + ahead + cost)) {
+            return true;
+        }
+    }
+}
+
+bool token_bucket_atomic_allowed(TokenBucketAtomic *limiter,
+        unsigned int num_events)
+{
+    return allowed(limiter, num_events, NULL);
+}
+
+bool token_bucket_atomic_allowed_at(TokenBucketAtomic *limiter,
+        unsigned int num_events, uint64_t now)
+{
+    return allowed(limiter, num_events, &now);
+}
+
+unsigned int token_bucket_atomic_count_available(TokenBucketAtomic *limiter)
+{
+    const uint32_t tat = atomic_u32_load(&limiter->tat);
+    const uint32_t now = now_units(limiter, delay_get_timestamp());
+
+    uint32_t ahead;
+    get_ahead(limiter, tat, now, NULL, &ahead);
+    return (limiter->limit - ahead) / limiter->emission_interval;
+}
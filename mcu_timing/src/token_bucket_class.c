@@ -0,0 +1,100 @@
+#include "token_bucket_class.h"
+#include "delay.h"
+
+void token_bucket_class_init(TokenBucketClass *cls, TokenBucketClass *parent,
+        unsigned int assured_requests,
+        unsigned int ceiling_requests,
+        unsigned int interval_us,
+        unsigned int max_burst)
+{
+    if(ceiling_requests < assured_requests) {
+        ceiling_requests = assured_requests;
+    }
+    token_bucket_limiter_init(&cls->assured,
+            assured_requests, interval_us, max_burst);
+    token_bucket_limiter_init(&cls->ceiling,
+            ceiling_requests, interval_us, max_burst);
+    cls->assured_debt = 0;
+    cls->ceiling_debt = 0;
+    cls->parent = parent;
+}
+
+// Refill a bucket and repay its debt. Returns the tokens left.
+// This changes the bucket even if nothing is charged afterwards: the refill
+// goes to the debt first. Repaying as soon as tokens come in (instead of at
+// the next charge) means no refill is lost while the bucket is full and
+// still in debt, so the debt is always repaid at the full rate.
+static unsigned int available(TokenBucketLimiter *limiter, unsigned int *debt,
+        uint64_t now)
+{
+    *debt-= token_bucket_limiter_claim_up_to_at(limiter, *debt, now);
+    return limiter->available_tokens;
+}
+
+// Take tokens from a bucket: what is not available becomes debt. The debt is
+// not limited: every event that was sent is repaid, so a bucket never
+// allows more than its rate over time.
+static void charge(TokenBucketLimiter *limiter, unsigned int *debt,
+        unsigned int num_events, uint64_t now)
+{
+    *debt+= num_events
+        - token_bucket_limiter_claim_up_to_at(limiter, num_events, now);
+}
+
+// Check if a class can send within its assured rate
+static bool can_send(TokenBucketClass *cls, unsigned int num_events,
+        uint64_t now)
+{
+    return (available(&cls->assured, &cls->assured_debt, now) >= num_events);
+}
+
+// Check if a class has room below its ceiling
+static bool can_borrow(TokenBucketClass *cls, unsigned int num_events,
+        uint64_t now)
+{
+    return (available(&cls->ceiling, &cls->ceiling_debt, now) >= num_events);
+}
+
+bool token_bucket_class_allowed(TokenBucketClass *cls,
+        unsigned int num_events)
+{
+    return token_bucket_class_allowed_at(cls, num_events,
+            delay_get_timestamp());
+}
+
+bool token_bucket_class_allowed_at(TokenBucketClass *cls,
+        unsigned int num_events, uint64_t now)
+{
+    // Bring all buckets on the path up to date, so they can be charged.
+    // NOTE: this repays debt from the refills, also if the events are denied
+    // (see available())
+    bool allowed = false;
+    for(TokenBucketClass *c = cls; c; c = c->parent) {
+        const bool green = can_send(c, num_events, now);
+        const bool yellow = can_borrow(c, num_events, now);
+
+        if(!allowed) {
+            if(green) {
+                // This class (or the ancestor it borrows from) has tokens
+                allowed = true;
+            } else if(!yellow) {
+                // Over the ceiling: no need to look further
+                return false;
+            }
+        }
+    }
+    if(!allowed) {
+        return false;
+    }
+
+    for(TokenBucketClass *c = cls; c; c = c->parent) {
+        charge(&c->assured, &c->assured_debt, num_events, now);
+        charge(&c->ceiling, &c->ceiling_debt, num_events, now);
+    }
+    return true;
+}
+
+bool token_bucket_class_is_borrowing(TokenBucketClass *cls)
+{
+    return !can_send(cls, 1, delay_get_timestamp());
+}
@@ -2,62 +2,61 @@
 #include "delay.h"
 #include <c_utils/max.h>
 
+void token_bucket_policy_init(TokenBucketPolicy *policy,
+        unsigned int max_requests,
+        unsigned int interval_us,
+        unsigned int max_burst)
+{
+    policy->num_req_per_interval = max_requests;
+    policy->interval_us = interval_us;
+    policy->max_tokens = max_burst;
+
+    const uint64_t scaled_n_per_req = ((uint64_t)max_requests) * interval_us;
+    const uint64_t max_micro_tokens = ((uint64_t)max_burst) * interval_us;
+    policy->scaled_n_per_req = scaled_n_per_req;
+
+    // Without refill, the bucket never fills up
+    policy->refill_full_us = max_requests
+        ? ((max_micro_tokens + max_requests - 1) / max_requests) : UINT64_MAX;
+
+    // Reciprocal for micro_tokens / scaled_n_per_req (see Granlund &
+    // Montgomery, 'Division by invariant integers using multiplication',
+    // figure 4.1)
+    policy->recip_mul = 0;
+    policy->recip_shift1 = 0;
+    policy->recip_shift2 = 0;
+    if(scaled_n_per_req && (scaled_n_per_req <= UINT32_MAX)) {
+
+        unsigned int l = 0;
+        while((1ULL << l) < scaled_n_per_req) {
+            l++;
+        }
+        policy->recip_mul = ((((1ULL << l) - scaled_n_per_req) << 32)
+                / scaled_n_per_req) + 1;
+        policy->recip_shift1 = (l < 1) ? l : 1;
+        policy->recip_shift2 = (l > 1) ? (l - 1) : 0;
+    }
+}
+
 void token_bucket_limiter_init(TokenBucketLimiter* limiter,
         unsigned int max_requests,
         unsigned int interval_us,
         unsigned int max_burst)
 {
-    limiter->num_req_per_interval = max_requests;
-    limiter->interval_us = interval_us;
-    limiter->max_tokens = max_burst;
+    token_bucket_policy_init(&limiter->policy,
+            max_requests, interval_us, max_burst);
 
-    limiter->available_tokens = limiter->max_tokens;
+    limiter->available_tokens = limiter->policy.max_tokens;
+    limiter->reserved_tokens = 0;
     limiter->micro_tokens = 0;
     limiter->timestamp = delay_get_timestamp();
 }
 
-/*
- * Every interval 'num_req_per_interval' tokens are added, up to max_burst.
- *
- * Implementation: instead of directly storing tokens,
- * they are first stored as multiple of the time interval:
- * 1 token = 'interval' microtokens.
- *
- * When enough microtokens are buffered to form a multiple of 'num_req_pre_interval',
- * they are converted to 'available_tokens'.
- * This approach allows precise calculations without depending on a fixed-frequency
- * update of the available tokens.
- */
-static void update(TokenBucketLimiter *limiter)
+static void update(TokenBucketLimiter *limiter, uint64_t now)
 {
-    const unsigned int n_per_req = limiter->num_req_per_interval;
-    const uint64_t scale_factor = limiter->interval_us;
-
-    // add 'num_req_per_interval' new micro_tokens every 'interval_us' microseconds
-    uint64_t now = delay_get_timestamp();
-    uint64_t new_micros = delay_calc_time_us(limiter->timestamp, now);
-    const uint64_t new_u_tokens = new_micros * n_per_req;
-    limiter->timestamp = now;
-       
-    const uint64_t max_new = ((limiter->max_tokens - limiter->available_tokens)
-        * scale_factor);
-
-    if(new_u_tokens > max_new) {
-        limiter->micro_tokens = max_new;
-
-    } else if((max_new - new_u_tokens) < limiter->micro_tokens) {
-        limiter->micro_tokens = max_new;
-
-    } else {
-        limiter->micro_tokens+= new_u_tokens;
-    }
-
-    // Normalize: move any multiple of 'n_per_req' micro_tokens from
-    // the microtokens buffer to the available_tokens
-    const unsigned int scaled_n_per_req = n_per_req * scale_factor;
-    const unsigned int available = n_per_req * (limiter->micro_tokens / (scaled_n_per_req));
-    limiter->micro_tokens-= (available * scale_factor);
-    limiter->available_tokens+= available;
+    token_bucket_policy_refill_at(&limiter->policy,
+            &limiter->available_tokens, &limiter->micro_tokens,
+            &limiter->timestamp, now);
 }
 
 
@@ -65,8 +64,14 @@ static void update(TokenBucketLimiter *limiter)
 bool token_bucket_limiter_allowed(TokenBucketLimiter* limiter,
         unsigned int num_events)
 {
+    return token_bucket_limiter_allowed_at(limiter, num_events,
+            delay_get_timestamp());
+}
 
-    update(limiter);
+bool token_bucket_limiter_allowed_at(TokenBucketLimiter* limiter,
+        unsigned int num_events, uint64_t now)
+{
+    update(limiter, now);
 
     if(limiter->available_tokens < num_events) {
         return false;
@@ -78,8 +83,61 @@ bool token_bucket_limiter_allowed(TokenBucketLimiter* limiter,
 
 unsigned int token_bucket_limiter_count_available(TokenBucketLimiter* limiter)
 {
-    update(limiter);
+    return token_bucket_limiter_count_available_at(limiter,
+            delay_get_timestamp());
+}
+
+unsigned int token_bucket_limiter_count_available_at(
+        TokenBucketLimiter* limiter, uint64_t now)
+{
+    update(limiter, now);
 
     return limiter->available_tokens;
 }
 
+unsigned int token_bucket_limiter_claim_up_to(TokenBucketLimiter* limiter,
+        unsigned int max_events)
+{
+    return token_bucket_limiter_claim_up_to_at(limiter, max_events,
+            delay_get_timestamp());
+}
+
+unsigned int token_bucket_limiter_claim_up_to_at(TokenBucketLimiter* limiter,
+        unsigned int max_events, uint64_t now)
+{
+    update(limiter, now);
+
+    const unsigned int claimed = (limiter->available_tokens < max_events)
+        ? limiter->available_tokens : max_events;
+    limiter->available_tokens-= claimed;
+    return claimed;
+}
+
+unsigned int token_bucket_limiter_reserve(TokenBucketLimiter* limiter,
+        unsigned int max_events)
+{
+    return token_bucket_limiter_reserve_at(limiter, max_events,
+            delay_get_timestamp());
+}
+
+unsigned int token_bucket_limiter_reserve_at(TokenBucketLimiter* limiter,
+        unsigned int max_events, uint64_t now)
+{
+    const unsigned int reserved =
+        token_bucket_limiter_claim_up_to_at(limiter, max_events, now);
+    limiter->reserved_tokens+= reserved;
+    return reserved;
+}
+
+void token_bucket_limiter_commit(TokenBucketLimiter* limiter,
+        unsigned int num_events)
+{
+    const unsigned int used = (num_events < limiter->reserved_tokens)
+        ? num_events : limiter->reserved_tokens;
+    const unsigned int unused = limiter->reserved_tokens - used;
+    limiter->reserved_tokens = 0;
+
+    const unsigned int room = limiter->policy.max_tokens
+        - limiter->available_tokens;
+    limiter->available_tokens+= (unused < room) ? unused : room;
+}
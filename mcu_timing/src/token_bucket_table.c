@@ -0,0 +1,169 @@
+#include "token_bucket_table.h"
+#include "delay.h"
+#include <limits.h>
+
+// The key and token arrays share one storage word per entry
+#if (UINT_MAX != 0xFFFFFFFF)
+    #error token_bucket_table assumes a 32-bit unsigned int
+#endif
+
+#define NONE (-1)
+
+bool token_bucket_table_init(TokenBucketTable *table,
+        const TokenBucketPolicy *policy,
+        uint64_t *storage, uint32_t capacity)
+{
+    if(!capacity || (capacity & (capacity - 1))) {
+        return false;
+    }
+
+    table->policy = policy;
+    table->mask = capacity - 1;
+
+    table->micro_tokens = &storage[0];
+    table->timestamps = &storage[capacity];
+    table->keys = (uint32_t *)&storage[2 * capacity];
+    table->available_tokens = (unsigned int *)&table->keys[capacity];
+
+    for(uint32_t i=0; i < capacity; i++) {
+        table->keys[i] = TOKEN_BUCKET_TABLE_EMPTY;
+    }
+    table->count = 0;
+    table->evictions = 0;
+    return true;
+}
+
+static uint32_t hash(uint32_t key)
+{
+    const uint32_t h = key * 0x9E3779B1UL;
+    return h ^ (h >> 16);
+}
+
+static uint32_t num_probes(const TokenBucketTable *table)
+{
+    return (table->mask < TOKEN_BUCKET_TABLE_MAX_PROBES)
+        ? (table->mask + 1) : TOKEN_BUCKET_TABLE_MAX_PROBES;
+}
+
+static int find(const TokenBucketTable *table, uint32_t key)
+{
+    const uint32_t start = hash(key);
+    const uint32_t probes = num_probes(table);
+    for(uint32_t p=0; p < probes; p++) {
+        const uint32_t i = (start + p) & table->mask;
+        if(table->keys[i] == key) {
+            return i;
+        }
+    }
+    return NONE;
+}
+
+// Add a key that is not in the table yet. This evicts the least recently used
+// key in the probe range if there is no free entry.
+static int insert(TokenBucketTable *table, uint32_t key, uint64_t now)
+{
+    const uint32_t start = hash(key);
+    const uint32_t probes = num_probes(table);
+
+    uint32_t victim = start & table->mask;
+    bool evict = true;
+    for(uint32_t p=0; p < probes; p++) {
+        const uint32_t i = (start + p) & table->mask;
+        if(table->keys[i] == TOKEN_BUCKET_TABLE_EMPTY) {
+            victim = i;
+            evict = false;
+            break;
+        }
+        if(table->timestamps[i] < table->timestamps[victim]) {
+            victim = i;
+        }
+    }
+    if(evict) {
+        table->evictions++;
+    } else {
+        table->count++;
+    }
+
+    table->keys[victim] = key;
+    table->available_tokens[victim] = table->policy->max_tokens;
+    table->micro_tokens[victim] = 0;
+    table->timestamps[victim] = now;
+    return victim;
+}
+
+static void update(TokenBucketTable *table, int i, uint64_t now)
+{
+    token_bucket_policy_refill_at(table->policy,
+            &table->available_tokens[i], &table->micro_tokens[i],
+            &table->timestamps[i], now);
+}
+
+bool token_bucket_table_allowed(TokenBucketTable *table, uint32_t key,
+        unsigned int num_events)
+{
+    return token_bucket_table_allowed_at(table, key, num_events,
+            delay_get_timestamp());
+}
+
+bool token_bucket_table_allowed_at(TokenBucketTable *table, uint32_t key,
+        unsigned int num_events, uint64_t now)
+{
+    if(key == TOKEN_BUCKET_TABLE_EMPTY) {
+        return false;
+    }
+
+    int i = find(table, key);
+    if(i == NONE) {
+        i = insert(table, key, now);
+    } else {
+        update(table, i, now);
+    }
+
+    if(table->available_tokens[i] < num_events) {
+        return false;
+    }
+    table->available_tokens[i]-= num_events;
+    return true;
+}
+
+unsigned int token_bucket_table_count_available(TokenBucketTable *table,
+        uint32_t key)
+{
+    return token_bucket_table_count_available_at(table, key,
+            delay_get_timestamp());
+}
+
+unsigned int token_bucket_table_count_available_at(TokenBucketTable *table,
+        uint32_t key, uint64_t now)
+{
+    if(key == TOKEN_BUCKET_TABLE_EMPTY) {
+        return 0;
+    }
+
+    const int i = find(table, key);
+    if(i == NONE) {
+        return table->policy->max_tokens;
+    }
+    update(table, i, now);
+    return table->available_tokens[i];
+}
+
+bool token_bucket_table_remove(TokenBucketTable *table, uint32_t key)
+{
+    if(key == TOKEN_BUCKET_TABLE_EMPTY) {
+        return false;
+    }
+
+    const int i = find(table, key);
+    if(i == NONE) {
+        return false;
+    }
+    table->keys[i] = TOKEN_BUCKET_TABLE_EMPTY;
+    table->count--;
+    return true;
+}
+
+uint32_t token_bucket_table_count(TokenBucketTable *table)
+{
+    return table->count;
+}
@@ -0,0 +1,122 @@
+#ifndef TIMEOUT_SET_H
+#define TIMEOUT_SET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "deadline_heap.h"
+
+// Max amount of timeouts in a set (max 0xFFFE)
+#if (!defined(TIMEOUT_SET_MAX))
+    #define TIMEOUT_SET_MAX (16)
+#endif
+
+/**
+ * A set of non-blocking timeouts, to replace polling many delay_timeout_t
+ * with delay_timeout_done().
+ *
+ * Each timeout is identified by an id in the range [0, TIMEOUT_SET_MAX).
+ * The targets are kept in a min-heap (see deadline_heap.h), so:
+ *  - the earliest expiry is known in O(1), e.g. to decide how long to sleep
+ *  - arm, re-arm and cancel are O(log n)
+ *  - checking for expired timeouts reads the timer only once, and only
+ *    touches the timeouts that expired
+ *
+ * A timeout can have slack: it may be handled up to that much later than its
+ * target. Sleep until timeout_set_next_wakeup() instead of the earliest
+ * expiry, so timeouts with overlapping windows expire in one wake-up.
+ *
+ * An expired timeout is removed from the set: re-arm it to use it again.
+ * Not thread-safe: use a set from one context only.
+ */
+typedef struct {
+    DeadlineHeap heap;
+    DeadlineHeapNode nodes[TIMEOUT_SET_MAX];
+    uint16_t positions[TIMEOUT_SET_MAX];
+    uint64_t slack[TIMEOUT_SET_MAX];
+} TimeoutSet;
+
+/**
+ * Initialize an empty set
+ */
+void timeout_set_init(TimeoutSet *set);
+
+/**
+ * Arm a timeout that expires 'microseconds' from now. If the timeout is
+ * already armed, it is re-armed with the new time.
+ *
+ * @return  False if the id is out of range
+ */
+bool timeout_set_arm(TimeoutSet *set, uint16_t id, uint64_t microseconds);
+
+/**
+ * Same as timeout_set_arm(), relative to a timestamp 'now' from
+ * delay_get_timestamp() (see delay_timeout_set_at())
+ */
+bool timeout_set_arm_at(TimeoutSet *set, uint16_t id, uint64_t now,
+        uint64_t microseconds);
+
+/**
+ * Same as timeout_set_arm_at(), with a slack of 'slack_us' microseconds
+ */
+bool timeout_set_arm_slack_at(TimeoutSet *set, uint16_t id, uint64_t now,
+        uint64_t microseconds, uint64_t slack_us);
+
+/**
+ * Cancel a timeout.
+ *
+ * @return  True if the timeout was armed
+ */
+bool timeout_set_cancel(TimeoutSet *set, uint16_t id);
+
+/**
+ * Check if a timeout is armed (and did not expire yet)
+ */
+bool timeout_set_is_armed(const TimeoutSet *set, uint16_t id);
+
+/**
+ * Collect the expired timeouts and remove them from the set.
+ *
+ * The timer is read once. The ids are returned in order of expiry. If more
+ * than 'max_ids' timeouts expired, the rest stays in the set for the next
+ * call.
+ *
+ * @param ids       Output: the expired ids
+ * @param max_ids   Size of 'ids'
+ *
+ * @return          The amount of expired ids
+ */
+uint16_t timeout_set_expired(TimeoutSet *set, uint16_t *ids, uint16_t max_ids);
+
+/**
+ * Same as timeout_set_expired(), for a timestamp 'now' from
+ * delay_get_timestamp()
+ */
+uint16_t timeout_set_expired_at(TimeoutSet *set, uint64_t now,
+        uint16_t *ids, uint16_t max_ids);
+
+/**
+ * Get the earliest expiry.
+ *
+ * @param timestamp     Set to the target timestamp of the timeout that
+ *                      expires first (see delay_get_timestamp())
+ *
+ * @return              The id that expires first, or DEADLINE_HEAP_NONE if
+ *                      the set is empty
+ */
+uint16_t timeout_set_next_expiry(const TimeoutSet *set, uint64_t *timestamp);
+
+/**
+ * Get the latest timestamp to wake up at: the earliest target + slack.
+ * At that moment, all timeouts whose window is open expire together.
+ *
+ * @return  False if the set is empty
+ */
+bool timeout_set_next_wakeup(const TimeoutSet *set, uint64_t *timestamp);
+
+/**
+ * Time in microseconds until the earliest expiry, e.g. to decide how long
+ * to sleep. 0 if a timeout already expired, UINT64_MAX if the set is empty.
+ */
+uint64_t timeout_set_next_expiry_us(const TimeoutSet *set);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Amount of slots per wheel level is 2^TIMER_WHEEL_SLOT_BITS.
+// The levels together cover the full 32-bit tick range, so this must divide 32.
+// More bits per level means fewer cascades but more RAM per wheel.
+#if (!defined(TIMER_WHEEL_SLOT_BITS))
+    #define TIMER_WHEEL_SLOT_BITS (4)
+#endif
+
+#if ((32 % TIMER_WHEEL_SLOT_BITS) != 0)
+    #error TIMER_WHEEL_SLOT_BITS should divide 32
+#endif
+
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS  (32 / TIMER_WHEEL_SLOT_BITS)
+
+// Marks the end of a list / an invalid entry index
+#define TIMER_WHEEL_NONE    (0xFFFF)
+
+typedef struct {
+    uint32_t expires;
+    uint16_t next;
+    uint16_t prev;
+    uint16_t slot;
+} TimerWheelEntry;
+
+typedef struct {
+    TimerWheelEntry *entries;
+    uint16_t num_entries;
+
+    uint16_t slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+    uint16_t expired;
+    uint32_t now;
+} TimerWheel;
+
+/**
+ * Initialize a hierarchical timing wheel.
+ *
+ * The wheel does not own any timers: the caller provides an array of
+ * 'num_entries' entries, which are referred to by their index in that array.
+ * Insert, cancel and expiry of a single timer are all O(1): the per-tick
+ * cost does not depend on the amount of armed timers.
+ *
+ * @param entries       Array of timer entries. Its size limits the amount of
+ *                      timers that can be armed at the same time.
+ * @param num_entries   Size of the entries array (max 0xFFFE)
+ * @param now           Initial tick count
+ */
+void timer_wheel_init(TimerWheel *wheel, TimerWheelEntry *entries,
+        uint16_t num_entries, uint32_t now);
+
+/**
+ * Arm a timer to expire 'ticks' ticks from now.
+ *
+ * If the timer was already armed, it is re-armed.
+ *
+ * @param index     Index into the entries array given to timer_wheel_init()
+ * @param ticks     Amount of ticks (1 or more) until the timer expires.
+ *                  The timer expires during the timer_wheel_tick() call that
+ *                  advances the wheel to (now + ticks).
+ */
+bool timer_wheel_add(TimerWheel *wheel, uint16_t index, uint32_t ticks);
+
+/**
+ * Cancel a timer. Does nothing if the timer is not armed.
+ */
+void timer_wheel_cancel(TimerWheel *wheel, uint16_t index);
+
+/**
+ * Check if a timer is armed (or expired, but not yet popped).
+ */
+bool timer_wheel_is_armed(TimerWheel *wheel, uint16_t index);
+
+/**
+ * Advance the wheel by one tick.
+ *
+ * All timers that expire at the new tick count are moved to the 'expired'
+ * list. Use timer_wheel_pop_expired() to retrieve them.
+ */
+void timer_wheel_tick(TimerWheel *wheel);
+
+/**
+ * Get the next expired timer.
+ *
+ * @return      Index of an expired timer, or TIMER_WHEEL_NONE if no timers
+ *              expired. The returned timer is no longer armed, so it can be
+ *              re-armed with timer_wheel_add().
+ */
+uint16_t timer_wheel_pop_expired(TimerWheel *wheel);
+
+#endif
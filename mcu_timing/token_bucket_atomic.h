@@ -0,0 +1,80 @@
+#ifndef TOKEN_BUCKET_ATOMIC_H
+#define TOKEN_BUCKET_ATOMIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lock-free token bucket rate limiter, safe to share between interrupts and
+ * the main loop (or between threads on the host).
+ *
+ * The state is a single 32-bit word: the GCRA 'theoretical arrival time'
+ * (TAT) of the next event, in units of 1/num_req_per_interval microseconds.
+ * In those units, every token takes 'interval_us' units to refill.
+ * An event is allowed if the TAT after the event is at most
+ * max_burst * interval_us units ahead of the current time. The TAT is updated
+ * with compare-and-swap, so concurrent calls are linearizable.
+ *
+ * Differences with TokenBucketLimiter:
+ *  - Tokens refill continuously (one every interval_us / num_req_per_interval
+ *    microseconds) instead of in groups of num_req_per_interval.
+ *  - The TAT is kept modulo 2^32: a TAT that is more than the burst ahead
+ *    of the current time is from a long idle time, and is treated as
+ *    'bucket full'. Only if the limiter was idle for a multiple of 2^32
+ *    units (about 71 / num_req_per_interval minutes), give or take the
+ *    burst, the stale TAT looks current: the limiter is then limited for at
+ *    most the time to refill the burst, as if those events just happened.
+ *  - On Cortex-M0 (no exclusive access instructions), the CAS masks
+ *    interrupts instead. That is safe against interrupts on the same core,
+ *    but NOT against the other core: on the LPC43xx, a limiter can be shared
+ *    lock-free between the M4 and its interrupts, but not with the M0.
+ */
+typedef struct {
+    uint32_t emission_interval;     // units per token (interval_us)
+    uint32_t limit;                 // max_burst * emission_interval
+    uint32_t num_req_per_interval;
+    uint32_t max_tokens;
+    volatile uint32_t tat;
+} TokenBucketAtomic;
+
+/**
+ * Initialize a lock-free rate limiter.
+ *
+ * The settings are the same as for token_bucket_limiter_init(). Initially,
+ * the bucket is full.
+ *
+ * @return  False if max_burst * interval_us is 2^31 or more, or any of the
+ *          settings is 0.
+ */
+bool token_bucket_atomic_init(TokenBucketAtomic *limiter,
+        unsigned int max_requests,
+        unsigned int interval_us,
+        unsigned int max_burst);
+
+/**
+ * Check if a specified amount of events is allowed (all or nothing), like
+ * token_bucket_limiter_allowed(). This can be called concurrently.
+ */
+bool token_bucket_atomic_allowed(TokenBucketAtomic *limiter,
+        unsigned int num_events);
+
+/**
+ * Same as token_bucket_atomic_allowed(), with an explicit timestamp 'now'
+ * from delay_get_timestamp().
+ *
+ * Another caller may have updated the limiter with a later timestamp. If
+ * the TAT is more than the burst ahead of 'now', the current time is read:
+ * if the TAT is within the burst of the current time, 'now' is outdated and
+ * the events are denied. Otherwise, the TAT is stale and the bucket is full.
+ * (token_bucket_atomic_allowed() reads the time after the TAT, so it never
+ * sees an outdated time.)
+ */
+bool token_bucket_atomic_allowed_at(TokenBucketAtomic *limiter,
+        unsigned int num_events, uint64_t now);
+
+/**
+ * Check how many events would be allowed at this moment
+ */
+unsigned int token_bucket_atomic_count_available(TokenBucketAtomic *limiter);
+
+#endif
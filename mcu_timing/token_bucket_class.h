@@ -0,0 +1,83 @@
+#ifndef TOKEN_BUCKET_CLASS_H
+#define TOKEN_BUCKET_CLASS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "token_bucket_limiter.h"
+
+/**
+ * Hierarchical token bucket (HTB-style) rate limiter, to share one link
+ * between traffic classes.
+ *
+ * Each class has two token buckets:
+ *  - assured:  the rate the class is guaranteed
+ *  - ceiling:  the max rate of the class, including capacity borrowed from
+ *              its parent when other classes are idle
+ *
+ * The classes form a tree: the root class represents the link (its ceiling
+ * is normally equal to its assured rate). Every event is charged to the
+ * buckets of the class and all of its ancestors. A class may send when:
+ *  - its assured bucket has enough tokens, or
+ *  - its ceiling bucket has enough tokens, and it can borrow: the nearest
+ *    ancestor with enough assured tokens is found, and every class up to that
+ *    ancestor has enough ceiling tokens.
+ *
+ * A bucket that is charged more than it holds (e.g. a parent charged for the
+ * guaranteed traffic of a child, or a class that borrowed) goes into debt:
+ * the debt is repaid from its refill before it has tokens again. Every check
+ * repays debt from the refill so far, also if the events are then denied.
+ * The debt is not limited, so no overdraft is forgotten. The assured rates
+ * of the children of a class should add up to at most the assured rate of
+ * that class, otherwise the guarantees can exceed the link capacity (and the
+ * debt of the link keeps growing).
+ */
+typedef struct TokenBucketClass {
+    TokenBucketLimiter assured;
+    TokenBucketLimiter ceiling;
+    unsigned int assured_debt;
+    unsigned int ceiling_debt;
+
+    struct TokenBucketClass *parent;
+} TokenBucketClass;
+
+/**
+ * Initialize a traffic class.
+ *
+ * @param cls               Class to initialize
+ * @param parent            Parent class, or NULL for the root (link) class
+ * @param assured_requests  Guaranteed amount of events per 'interval_us'
+ * @param ceiling_requests  Max amount of events per 'interval_us', including
+ *                          borrowed capacity (at least assured_requests)
+ * @param interval_us       Interval in microseconds
+ * @param max_burst         Bucket size of both buckets, see
+ *                          token_bucket_limiter_init()
+ */
+void token_bucket_class_init(TokenBucketClass *cls, TokenBucketClass *parent,
+        unsigned int assured_requests,
+        unsigned int ceiling_requests,
+        unsigned int interval_us,
+        unsigned int max_burst);
+
+/**
+ * Check if a specified amount of events is allowed for a class
+ * (all or nothing). If allowed, the events are charged to the class and all
+ * of its ancestors.
+ */
+bool token_bucket_class_allowed(TokenBucketClass *cls,
+        unsigned int num_events);
+
+/**
+ * Same as token_bucket_class_allowed(), with an explicit timestamp 'now'
+ * from delay_get_timestamp(). This is also used internally: all the buckets
+ * on the path to the root share one timer read.
+ */
+bool token_bucket_class_allowed_at(TokenBucketClass *cls,
+        unsigned int num_events, uint64_t now);
+
+/**
+ * Check if a class is currently borrowing: its assured bucket is empty or in
+ * debt, so it can only send with capacity from its ancestors.
+ */
+bool token_bucket_class_is_borrowing(TokenBucketClass *cls);
+
+#endif
@@ -3,21 +3,162 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "delay.h"
 
+/**
+ * Rate limit settings. A policy can be shared by many limiters
+ * (see token_bucket_table.h).
+ *
+ * The derived values are precomputed by token_bucket_policy_init(), so the
+ * refill does not need a (64-bit, software on Cortex-M) division:
+ *
+ *  scaled_n_per_req    num_req_per_interval * interval_us: the amount of
+ *                      micro tokens per 'num_req_per_interval' tokens
+ *  refill_full_us      Time to refill an empty bucket completely
+ *  recip_mul,          Multiply-shift reciprocal of scaled_n_per_req
+ *  recip_shift1,       (Granlund-Montgomery), exact for any dividend below
+ *  recip_shift2        2^32. A bucket holds at most max_tokens * interval_us
+ *                      micro tokens, so that is the normal case. recip_mul
+ *                      is 0 if scaled_n_per_req does not fit in 32 bits:
+ *                      then (like for larger dividends) a division is used.
+ */
 typedef struct {
-    
-    // settings
     unsigned int num_req_per_interval;
     unsigned int interval_us;
     unsigned int max_tokens;
 
+    uint64_t scaled_n_per_req;
+    uint64_t refill_full_us;
+    uint32_t recip_mul;
+    uint8_t recip_shift1;
+    uint8_t recip_shift2;
+} TokenBucketPolicy;
+
+typedef struct {
+    
+    // settings
+    TokenBucketPolicy policy;
+
     // state
     unsigned int available_tokens;
+    unsigned int reserved_tokens;
     uint64_t micro_tokens;
     uint64_t timestamp;
 
 } TokenBucketLimiter;
 
+/**
+ * Initialize a rate limit policy: see token_bucket_limiter_init()
+ */
+void token_bucket_policy_init(TokenBucketPolicy *policy,
+        unsigned int max_requests,
+        unsigned int interval_us,
+        unsigned int max_burst);
+
+/**
+ * Calculate micro_tokens / scaled_n_per_req
+ */
+static inline uint64_t token_bucket_policy_divide(
+        const TokenBucketPolicy *policy, uint64_t micro_tokens)
+{
+    if(!policy->recip_mul || (micro_tokens >> 32)) {
+        return micro_tokens / policy->scaled_n_per_req;
+    }
+
+    const uint32_t n = micro_tokens;
+    const uint32_t t = (((uint64_t)n) * policy->recip_mul) >> 32;
+    return (t + ((n - t) >> policy->recip_shift1)) >> policy->recip_shift2;
+}
+
+/**
+ * Add the tokens for 'elapsed_us' microseconds to a token bucket state.
+ *
+ * This is the refill logic shared by all token bucket based limiters.
+ *
+ * Every interval 'num_req_per_interval' tokens are added, up to max_tokens.
+ *
+ * Implementation: instead of directly storing tokens,
+ * they are first stored as multiple of the time interval:
+ * 1 token = 'interval' microtokens.
+ *
+ * When enough microtokens are buffered to form a multiple of 'num_req_pre_interval',
+ * they are converted to 'available_tokens'.
+ * This approach allows precise calculations without depending on a fixed-frequency
+ * update of the available tokens.
+ *
+ * @param policy            Rate limit settings
+ * @param available_tokens  Whole tokens in the bucket, updated in place
+ * @param micro_tokens      Partial tokens in the bucket (scaled by the
+ *                          interval), updated in place
+ * @param elapsed_us        Time since the previous refill
+ */
+static inline void token_bucket_policy_refill(const TokenBucketPolicy *policy,
+        unsigned int *available_tokens, uint64_t *micro_tokens,
+        uint64_t elapsed_us)
+{
+    const unsigned int n_per_req = policy->num_req_per_interval;
+    const uint64_t scale_factor = policy->interval_us;
+
+    const uint64_t max_new = ((policy->max_tokens - *available_tokens)
+        * scale_factor);
+
+    // add 'num_req_per_interval' new micro_tokens every 'interval_us'
+    // microseconds. After a long time, the bucket is simply full: this also
+    // prevents the multiplication from overflowing.
+    if(elapsed_us >= policy->refill_full_us) {
+        *micro_tokens = max_new;
+    } else {
+        const uint64_t new_u_tokens = elapsed_us * n_per_req;
+        if(new_u_tokens > max_new) {
+            *micro_tokens = max_new;
+
+        } else if((max_new - new_u_tokens) < *micro_tokens) {
+            *micro_tokens = max_new;
+
+        } else {
+            *micro_tokens+= new_u_tokens;
+        }
+    }
+    if(!policy->scaled_n_per_req) {
+        return;
+    }
+
+    // Normalize: move any multiple of 'n_per_req' micro_tokens from
+    // the microtokens buffer to the available_tokens
+    const unsigned int available = n_per_req
+        * token_bucket_policy_divide(policy, *micro_tokens);
+    *micro_tokens-= (available * scale_factor);
+    *available_tokens+= available;
+}
+
+/**
+ * Refill a bucket for the time since '*timestamp' (see
+ * token_bucket_policy_refill()), and move '*timestamp' forward.
+ *
+ * Only whole microseconds are credited, so '*timestamp' only moves by the
+ * ticks of those microseconds: the rest carries over to the next refill.
+ * A tick can be much shorter than a microsecond (DELAY_TIMER_FULL_RATE).
+ *
+ * @param timestamp         Timestamp of the previous refill, updated in place
+ * @param now               Timestamp from delay_get_timestamp()
+ */
+static inline void token_bucket_policy_refill_at(
+        const TokenBucketPolicy *policy,
+        unsigned int *available_tokens, uint64_t *micro_tokens,
+        uint64_t *timestamp, uint64_t now)
+{
+    if(now <= *timestamp) {
+        return;
+    }
+    const uint64_t elapsed = now - *timestamp;
+    const uint64_t elapsed_us = delay_ticks_to_us(elapsed);
+    const uint64_t used = delay_us_to_ticks(elapsed_us);
+    *timestamp+= (used < elapsed) ? used : elapsed;
+
+    token_bucket_policy_refill(policy, available_tokens, micro_tokens,
+            elapsed_us);
+}
+
 /**
  * Initialize a rate limiter based on the token bucket algorithm.
  *
@@ -63,5 +204,53 @@ bool token_bucket_limiter_allowed(TokenBucketLimiter* limiter,
  */
 unsigned int token_bucket_limiter_count_available(TokenBucketLimiter* limiter);
 
+/**
+ * Claim as many events as are available, up to 'max_events'.
+ *
+ * Unlike token_bucket_limiter_allowed(), this grants a partial request:
+ * a batching producer can claim a whole batch with a single refill, instead of
+ * claiming one event at a time.
+ *
+ * @return  The amount of events claimed (0 .. max_events)
+ */
+unsigned int token_bucket_limiter_claim_up_to(TokenBucketLimiter* limiter,
+        unsigned int max_events);
+
+/**
+ * Reserve up to 'max_events' events, to size a transfer before it is
+ * started (e.g. a DMA transfer). Finish the reservation with
+ * token_bucket_limiter_commit().
+ *
+ * The reserved events are removed from the bucket like for
+ * token_bucket_limiter_claim_up_to(). Only one reservation per limiter can be
+ * outstanding at a time.
+ *
+ * @return  The amount of events reserved (0 .. max_events)
+ */
+unsigned int token_bucket_limiter_reserve(TokenBucketLimiter* limiter,
+        unsigned int max_events);
+
+/**
+ * Finish a reservation: 'num_events' of the reserved events were used, the
+ * rest is returned to the bucket (never above the burst limit).
+ * 'num_events' is limited to the amount that was reserved.
+ */
+void token_bucket_limiter_commit(TokenBucketLimiter* limiter,
+        unsigned int num_events);
+
+/**
+ * Variants with an explicit timestamp 'now' from delay_get_timestamp(), to
+ * share one timer read between many limiters (see delay_timeout_set_at()).
+ * A timestamp older than the last update of the limiter does not refill it.
+ */
+bool token_bucket_limiter_allowed_at(TokenBucketLimiter* limiter,
+        unsigned int num_events, uint64_t now);
+unsigned int token_bucket_limiter_count_available_at(
+        TokenBucketLimiter* limiter, uint64_t now);
+unsigned int token_bucket_limiter_claim_up_to_at(TokenBucketLimiter* limiter,
+        unsigned int max_events, uint64_t now);
+unsigned int token_bucket_limiter_reserve_at(TokenBucketLimiter* limiter,
+        unsigned int max_events, uint64_t now);
+
 #endif
 
@@ -0,0 +1,106 @@
+#ifndef TOKEN_BUCKET_TABLE_H
+#define TOKEN_BUCKET_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "token_bucket_limiter.h"
+
+// Key value that can not be used: it marks an empty entry
+#define TOKEN_BUCKET_TABLE_EMPTY (0xFFFFFFFF)
+
+// Max amount of entries that are checked for a key. If all of them are in
+// use by other keys, the least recently used one is evicted.
+#if (!defined(TOKEN_BUCKET_TABLE_MAX_PROBES))
+    #define TOKEN_BUCKET_TABLE_MAX_PROBES (8)
+#endif
+
+// Size of the storage buffer (in uint64_t words) for a table of 'capacity'
+// entries: 24 bytes per entry.
+#define TOKEN_BUCKET_TABLE_STORAGE_WORDS(capacity) (3 * (capacity))
+
+/**
+ * Token bucket rate limiters for many keys (e.g. per client or per endpoint),
+ * that all share the same policy.
+ *
+ * The table uses open addressing with a bounded probe length, so a lookup
+ * costs at most TOKEN_BUCKET_TABLE_MAX_PROBES key compares. The state is
+ * stored as separate arrays (keys, tokens, timestamps) in a buffer provided
+ * by the caller: probing only touches the contiguous key array.
+ *
+ * A bucket is refilled lazily, when its key is looked up. Unknown keys start
+ * with a full bucket. When there is no free entry, the least recently used
+ * entry in the probe range is evicted: an idle key has a full bucket again,
+ * so evicting it does not change its rate limit. The table should be sized
+ * for the amount of active keys: evicting a key that is still limited resets
+ * its bucket.
+ */
+typedef struct {
+    const TokenBucketPolicy *policy;
+    uint32_t mask;              // capacity - 1
+
+    uint32_t *keys;
+    unsigned int *available_tokens;
+    uint64_t *micro_tokens;
+    uint64_t *timestamps;       // last access, for refill and eviction
+
+    uint32_t count;
+    uint32_t evictions;
+} TokenBucketTable;
+
+/**
+ * Initialize a token bucket table.
+ *
+ * @param table     Table to initialize
+ * @param policy    Rate limit settings for all keys. This is not copied:
+ *                  it should stay valid while the table is used.
+ * @param storage   Buffer of TOKEN_BUCKET_TABLE_STORAGE_WORDS(capacity) words
+ * @param capacity  Max amount of keys, should be a power of two
+ *
+ * @return          False if the capacity is not a power of two
+ */
+bool token_bucket_table_init(TokenBucketTable *table,
+        const TokenBucketPolicy *policy,
+        uint64_t *storage, uint32_t capacity);
+
+/**
+ * Check if a specified amount of events is allowed for a key.
+ *
+ * Like token_bucket_limiter_allowed(), but for the bucket of 'key'.
+ * If the key is not in the table yet, it is added.
+ *
+ * @return      True if the request is allowed, false if the limit is reached
+ *              or the key is TOKEN_BUCKET_TABLE_EMPTY.
+ */
+bool token_bucket_table_allowed(TokenBucketTable *table, uint32_t key,
+        unsigned int num_events);
+
+/**
+ * Check how many events would be allowed for a key at this moment.
+ *
+ * This does not add the key to the table.
+ */
+unsigned int token_bucket_table_count_available(TokenBucketTable *table,
+        uint32_t key);
+
+/**
+ * Variants with an explicit timestamp 'now' from delay_get_timestamp()
+ * (see token_bucket_limiter_allowed_at())
+ */
+bool token_bucket_table_allowed_at(TokenBucketTable *table, uint32_t key,
+        unsigned int num_events, uint64_t now);
+unsigned int token_bucket_table_count_available_at(TokenBucketTable *table,
+        uint32_t key, uint64_t now);
+
+/**
+ * Forget a key: its bucket is full again on the next lookup.
+ *
+ * @return      True if the key was in the table
+ */
+bool token_bucket_table_remove(TokenBucketTable *table, uint32_t key);
+
+/**
+ * Get the amount of keys in the table
+ */
+uint32_t token_bucket_table_count(TokenBucketTable *table);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+ * Microbenchmarks for the mcu_timing hot paths, running against the native
+ * host backend.
+ *
+ * Usage: mcu_timing_bench [--output <file.json>]
+ *                         [--baseline <file.json>] [--threshold <percent>]
+ *
+ * Results are written as JSON (to stdout by default). If a baseline
+ * (earlier output of this program) is given, the program fails when any
+ * benchmark is more than 'threshold' percent slower than in the baseline.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAVE_CYCLE_COUNTER (1)
+#else
+    #define HAVE_CYCLE_COUNTER (0)
+#endif
+
+#include "delay.h"
+#include "interval.h"
+#include "profile.h"
+#include "rate_limit.h"
+#include "token_bucket_limiter.h"
+#include "token_bucket_table.h"
+#include "token_bucket_atomic.h"
+#include "gcra_limiter.h"
+#include "timeout_set.h"
+
+// Each benchmark is repeated and the fastest run is reported:
+// slower runs are caused by noise (interrupts, scheduling, frequency scaling)
+#define NUM_RUNS            (7)
+#define MIN_RUN_TIME_NS     (20000000ULL)
+
+#define DEFAULT_THRESHOLD   (15.0)
+
+typedef void (*BenchFunc)(void *ctx, uint32_t iterations);
+
+typedef struct {
+    char name[48];
+    double ns_per_call;
+    double cycles_per_call;
+} BenchResult;
+
+#define MAX_RESULTS (32)
+static BenchResult g_results[MAX_RESULTS];
+static int g_num_results;
+
+// Results are accumulated here so the compiler can not optimize calls away
+static volatile uint64_t g_sink;
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((uint64_t)ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if HAVE_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void run_bench(const char *name, BenchFunc func, void *ctx)
+{
+    // Find an iteration count that takes long enough to measure
+    uint32_t iterations = 1000;
+    while(1) {
+        const uint64_t start = now_ns();
+        func(ctx, iterations);
+        const uint64_t elapsed = now_ns() - start;
+        if((elapsed >= MIN_RUN_TIME_NS) || (iterations >= (1UL << 30))) {
+            break;
+        }
+        iterations*= 2;
+    }
+
+    double best_ns = -1;
+    double best_cycles = -1;
+    for(int run=0; run < NUM_RUNS; run++) {
+        const uint64_t start_cycles = now_cycles();
+        const uint64_t start = now_ns();
+        func(ctx, iterations);
+        const uint64_t elapsed = now_ns() - start;
+        const uint64_t cycles = now_cycles() - start_cycles;
+
+        const double ns = (double)elapsed / iterations;
+        if((best_ns < 0) || (ns < best_ns)) {
+            best_ns = ns;
+            best_cycles = (double)cycles / iterations;
+        }
+    }
+
+    if(g_num_results < MAX_RESULTS) {
+        BenchResult *result = &g_results[g_num_results++];
+        snprintf(result->name, sizeof(result->name), "%s", name);
+        result->ns_per_call = best_ns;
+        result->cycles_per_call = best_cycles;
+    }
+}
+
+
+//
+// Benchmarks
+//
+
+static void bench_get_timestamp(void *ctx, uint32_t iterations)
+{
+    uint64_t sum = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        sum+= delay_get_timestamp();
+    }
+    g_sink = sum;
+}
+
+static void bench_get_timestamp_coarse(void *ctx, uint32_t iterations)
+{
+    uint64_t sum = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        sum+= delay_get_timestamp_coarse();
+    }
+    g_sink = sum;
+}
+
+static void bench_ticks_to_ns(void *ctx, uint32_t iterations)
+{
+    uint64_t sum = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        sum+= delay_ticks_to_ns(i);
+    }
+    g_sink = sum;
+}
+
+static void bench_timeout_done(void *ctx, uint32_t iterations)
+{
+    delay_timeout_t *timeout = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= delay_timeout_done(timeout);
+    }
+    g_sink = count;
+}
+
+// Poll a full set of timeouts that are not expired yet
+static void bench_timeout_set_expired(void *ctx, uint32_t iterations)
+{
+    TimeoutSet *set = ctx;
+    uint16_t ids[TIMEOUT_SET_MAX];
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= timeout_set_expired(set, ids, TIMEOUT_SET_MAX);
+    }
+    g_sink = count;
+}
+
+static void bench_token_bucket_allowed(void *ctx, uint32_t iterations)
+{
+    TokenBucketLimiter *limiter = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= token_bucket_limiter_allowed(limiter, 1);
+    }
+    g_sink = count;
+}
+
+static void bench_token_bucket_atomic_allowed(void *ctx, uint32_t iterations)
+{
+    TokenBucketAtomic *limiter = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= token_bucket_atomic_allowed(limiter, 1);
+    }
+    g_sink = count;
+}
+
+static void bench_gcra_limiter_allowed(void *ctx, uint32_t iterations)
+{
+    GcraLimiter *limiter = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= gcra_limiter_allowed(limiter, 1, NULL);
+    }
+    g_sink = count;
+}
+
+#define BENCH_BATCH_SIZE (16)
+
+typedef struct {
+    TokenBucketLimiter limiters[BENCH_BATCH_SIZE];
+    bool shared_timestamp;
+} TokenBucketBatch;
+
+// A control loop that checks a batch of limiters per iteration
+static void bench_token_bucket_batch(void *ctx, uint32_t iterations)
+{
+    TokenBucketBatch *batch = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        const uint64_t now = delay_get_timestamp();
+        for(int j=0; j < BENCH_BATCH_SIZE; j++) {
+            TokenBucketLimiter *limiter = &batch->limiters[j];
+            count+= batch->shared_timestamp
+                ? token_bucket_limiter_allowed_at(limiter, 1, now)
+                : token_bucket_limiter_allowed(limiter, 1);
+        }
+    }
+    g_sink = count;
+}
+
+#define BENCH_TABLE_KEYS (1024)
+
+static void bench_token_bucket_table_allowed(void *ctx, uint32_t iterations)
+{
+    TokenBucketTable *table = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= token_bucket_table_allowed(table, i % BENCH_TABLE_KEYS, 1);
+    }
+    g_sink = count;
+}
+
+static void bench_rate_limit_allowed(void *ctx, uint32_t iterations)
+{
+    RateLimit *limit = ctx;
+    uint64_t count = 0;
+    for(uint32_t i=0; i < iterations; i++) {
+        count+= rate_limit_allowed(limit);
+    }
+    g_sink = count;
+}
+
+static void bench_profile_start_end(void *ctx, uint32_t iterations)
+{
+    Profile *prof = ctx;
+    for(uint32_t i=0; i < iterations; i++) {
+        profile_start(prof);
+        profile_end(prof);
+    }
+    g_sink = prof->call_count;
+}
+
+static void dummy_cb(void) {}
+
+typedef struct {
+    IntervalList list;
+    uint32_t time;
+} IntervalBench;
+
+static void bench_interval_irq_handler(void *ctx, uint32_t iterations)
+{
+    IntervalBench *bench = ctx;
+    for(uint32_t i=0; i < iterations; i++) {
+        bench->time++;
+        if(!bench->time) {
+            bench->time++;
+        }
+        interval_irq_handler(&bench->list, bench->time);
+    }
+    g_sink = bench->list.counter;
+}
+
+static void run_all(void)
+{
+    run_bench("delay_get_timestamp", bench_get_timestamp, NULL);
+    run_bench("delay_get_timestamp_coarse", bench_get_timestamp_coarse, NULL);
+    run_bench("delay_ticks_to_ns", bench_ticks_to_ns, NULL);
+
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, 1000000000ULL);
+    run_bench("delay_timeout_done", bench_timeout_done, &timeout);
+
+    static TimeoutSet timeout_set;
+    timeout_set_init(&timeout_set);
+    for(uint16_t i=0; i < TIMEOUT_SET_MAX; i++) {
+        timeout_set_arm(&timeout_set, i, 1000000000ULL + i);
+    }
+    run_bench("timeout_set_expired", bench_timeout_set_expired, &timeout_set);
+
+    // Generous rate: a mix of allowed and disallowed requests
+    TokenBucketLimiter limiter;
+    token_bucket_limiter_init(&limiter, 10, 1, 100);
+    run_bench("token_bucket_limiter_allowed", bench_token_bucket_allowed,
+            &limiter);
+
+    static TokenBucketBatch batch;
+    for(int j=0; j < BENCH_BATCH_SIZE; j++) {
+        token_bucket_limiter_init(&batch.limiters[j], 10, 1, 100);
+    }
+    batch.shared_timestamp = false;
+    run_bench("token_bucket_limiter_allowed/batch_16", bench_token_bucket_batch,
+            &batch);
+    batch.shared_timestamp = true;
+    run_bench("token_bucket_limiter_allowed_at/batch_16",
+            bench_token_bucket_batch, &batch);
+
+    TokenBucketAtomic atomic_limiter;
+    token_bucket_atomic_init(&atomic_limiter, 10, 1, 100);
+    run_bench("token_bucket_atomic_allowed", bench_token_bucket_atomic_allowed,
+            &atomic_limiter);
+
+    GcraLimiter gcra;
+    gcra_limiter_init(&gcra, &limiter.policy);
+    run_bench("gcra_limiter_allowed", bench_gcra_limiter_allowed, &gcra);
+
+    static uint64_t table_storage[
+        TOKEN_BUCKET_TABLE_STORAGE_WORDS(2 * BENCH_TABLE_KEYS)];
+    TokenBucketTable table;
+    token_bucket_table_init(&table, &limiter.policy, table_storage,
+            2 * BENCH_TABLE_KEYS);
+    run_bench("token_bucket_table_allowed/1024", bench_token_bucket_table_allowed,
+            &table);
+
+    RateLimit limit;
+    rate_limit_init(&limit, 1, 1000, 10, 4);
+    run_bench("rate_limit_allowed", bench_rate_limit_allowed, &limit);
+
+    Profile prof;
+    profile_init(&prof, "bench", 0);
+    run_bench("profile_start_end", bench_profile_start_end, &prof);
+
+    profile_set_sampling(&prof, 16, false);
+    run_bench("profile_start_end/sampled_16", bench_profile_start_end, &prof);
+    profile_set_sampling(&prof, 16, true);
+    run_bench("profile_start_end/random_16", bench_profile_start_end, &prof);
+
+    static IntervalBench interval_bench;
+    const int sizes[] = {1, 4, 16, 64, 256};
+    for(size_t s=0; s < (sizeof(sizes) / sizeof(sizes[0])); s++) {
+        if(sizes[s] > MAX_INTERVALS) {
+            break;
+        }
+        interval_init(&interval_bench.list);
+        interval_bench.time = 0;
+        for(int i=0; i < sizes[s]; i++) {
+            // mix of short and long periods
+            interval_add(&interval_bench.list, 1 + ((i * 37) % 1000), dummy_cb);
+        }
+
+        char name[48];
+        snprintf(name, sizeof(name), "interval_irq_handler/%d", sizes[s]);
+        run_bench(name, bench_interval_irq_handler, &interval_bench);
+    }
+}
+
+
+//
+// Output and regression check
+//
+
+static void write_json(FILE *file)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for(int i=0; i < g_num_results; i++) {
+        const BenchResult *result = &g_results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_call\": %.3f, ",
+                result->name, result->ns_per_call);
+        if(HAVE_CYCLE_COUNTER) {
+            fprintf(file, "\"cycles_per_call\": %.3f}", result->cycles_per_call);
+        } else {
+            fprintf(file, "\"cycles_per_call\": null}");
+        }
+        fprintf(file, "%s\n", (i + 1 < g_num_results) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+static char *read_file(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if(!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = malloc(size + 1);
+    if(data) {
+        const size_t len = fread(data, 1, size, file);
+        data[len] = '\0';
+    }
+    fclose(file);
+    return data;
+}
+
+// Find the ns_per_call for a benchmark in the output of write_json()
+static bool baseline_lookup(const char *baseline, const char *name, double *ns)
+{
+    char key[sizeof(g_results[0].name) + 16];
+    snprintf(key, sizeof(key), "\"name\": \"%.47s\"", name);
+
+    const char *entry = strstr(baseline, key);
+    if(!entry) {
+        return false;
+    }
+    const char *value = strstr(entry, "\"ns_per_call\":");
+    if(!value) {
+        return false;
+    }
+    *ns = strtod(value + strlen("\"ns_per_call\":"), NULL);
+    return (*ns > 0);
+}
+
+static int check_regressions(const char *baseline_file, double threshold)
+{
+    char *baseline = read_file(baseline_file);
+    if(!baseline) {
+        fprintf(stderr, "could not read baseline '%s'\n", baseline_file);
+        return 1;
+    }
+
+    int num_regressions = 0;
+    for(int i=0; i < g_num_results; i++) {
+        const BenchResult *result = &g_results[i];
+        double baseline_ns;
+        if(!baseline_lookup(baseline, result->name, &baseline_ns)) {
+            fprintf(stderr, "%-32s no baseline\n", result->name);
+            continue;
+        }
+        const double change = 100.0 * ((result->ns_per_call / baseline_ns) - 1.0);
+        const bool regression = (change > threshold);
+        fprintf(stderr, "%-32s %9.3f ns (baseline %9.3f ns, %+6.1f%%)%s\n",
+                result->name, result->ns_per_call, baseline_ns, change,
+                regression ? " REGRESSION" : "");
+        if(regression) {
+            num_regressions++;
+        }
+    }
+    free(baseline);
+
+    if(num_regressions) {
+        fprintf(stderr, "%d benchmark(s) regressed more than %.1f%%\n",
+                num_regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    const char *baseline = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+
+    for(int i=1; i < argc; i++) {
+        if(!strcmp(argv[i], "--output") && (i + 1 < argc)) {
+            output = argv[++i];
+        } else if(!strcmp(argv[i], "--baseline") && (i + 1 < argc)) {
+            baseline = argv[++i];
+        } else if(!strcmp(argv[i], "--threshold") && (i + 1 < argc)) {
+            threshold = strtod(argv[++i], NULL);
+        } else {
+            fprintf(stderr, "usage: %s [--output <file.json>] "
+                    "[--baseline <file.json>] [--threshold <percent>]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    delay_init();
+    run_all();
+
+    if(output) {
+        FILE *file = fopen(output, "w");
+        if(!file) {
+            fprintf(stderr, "could not write '%s'\n", output);
+            return 1;
+        }
+        write_json(file);
+        fclose(file);
+    } else {
+        write_json(stdout);
+    }
+
+    if(baseline) {
+        return check_regressions(baseline, threshold);
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "delay.h"
+#include "delay_timer.h"
+#include <time.h>
+
+// These tests run against the real host backend (MCU_PLATFORM=host),
+// so they check lower bounds and generous upper bounds only.
+
+void test_timestamp_monotonic(void)
+{
+    delay_init();
+
+    uint64_t prev = delay_get_timestamp();
+    for(int i=0; i < 100000; i++) {
+        const uint64_t now = delay_get_timestamp();
+        TEST_ASSERT_TRUE(now >= prev);
+        prev = now;
+    }
+}
+
+void test_delay_us(void)
+{
+    delay_init();
+
+    const uint64_t start = delay_get_timestamp();
+    delay_us(2000);
+    const uint64_t elapsed = delay_calc_time_us(start, delay_get_timestamp());
+
+    TEST_ASSERT_TRUE(elapsed >= 2000);
+    TEST_ASSERT_TRUE(elapsed < 500000);
+}
+
+static uint64_t cpu_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (((uint64_t)ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+// sleeping: as precise as delay_us(), but (almost) no cpu time
+void test_delay_us_sleep(void)
+{
+    delay_init();
+
+    const uint64_t start_cpu = cpu_time_us();
+    const uint64_t start = delay_get_timestamp();
+    delay_us_sleep(20000);
+    const uint64_t elapsed = delay_calc_time_us(start, delay_get_timestamp());
+    const uint64_t cpu = cpu_time_us() - start_cpu;
+
+    TEST_ASSERT_TRUE(elapsed >= 20000);
+    TEST_ASSERT_TRUE(elapsed < 500000);
+    TEST_ASSERT_TRUE(cpu < 10000);
+
+    // short delays only spin
+    const uint64_t short_start = delay_get_timestamp();
+    delay_us_sleep(DELAY_SPIN_US / 2);
+    TEST_ASSERT_TRUE(delay_calc_time_us(short_start, delay_get_timestamp())
+            >= (DELAY_SPIN_US / 2));
+}
+
+// the coarse timestamp follows the precise one, in milliseconds
+void test_timestamp_coarse(void)
+{
+    delay_init();
+    delay_reinit(delay_us_to_ticks(5000000));
+
+    for(int i=0; i < 20; i++) {
+        const uint32_t coarse = delay_get_timestamp_coarse();
+        const uint64_t precise_ms =
+            delay_ticks_to_us(delay_get_timestamp()) / 1000;
+        TEST_ASSERT_TRUE(precise_ms >= 5000);
+        // generous bound: the host coarse clock has one kernel tick resolution
+        TEST_ASSERT_TRUE((coarse <= (precise_ms + 1))
+                && ((coarse + 20) >= precise_ms));
+        delay_us(1000);
+    }
+}
+
+void test_timeout(void)
+{
+    delay_init();
+
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, 1000);
+    TEST_ASSERT_FALSE(delay_timeout_done(&timeout));
+    delay_us(1000);
+    TEST_ASSERT_TRUE(delay_timeout_done(&timeout));
+}
+
+void test_timeout_at(void)
+{
+    delay_init();
+
+    const uint64_t now = delay_get_timestamp();
+    delay_timeout_t a, b;
+    delay_timeout_set_at(&a, now, 1000);
+    delay_timeout_set_at(&b, now, 2000);
+    TEST_ASSERT_FALSE(delay_timeout_done_at(&a, now));
+    TEST_ASSERT_TRUE(delay_timeout_done_at(&a, now + delay_us_to_ticks(1000)));
+    TEST_ASSERT_FALSE(delay_timeout_done_at(&b, now + delay_us_to_ticks(1000)));
+
+    delay_us(2000);
+    TEST_ASSERT_TRUE(delay_timeout_done(&b));
+}
+
+void test_reinit(void)
+{
+    delay_init();
+    delay_reinit(1000000000ULL);
+
+    const uint64_t now = delay_get_timestamp();
+    TEST_ASSERT_TRUE(now >= 1000000000ULL);
+    TEST_ASSERT_TRUE(now < (1000000000ULL + delay_us_to_ticks(500000)));
+}
+
+static volatile int g_called;
+
+static void timer_cb(void *ctx)
+{
+    g_called++;
+}
+
+// conversions for the host tick rate (1 MHz, or 1 GHz at full rate)
+void test_tick_conversion(void)
+{
+    delay_init();
+
+    const uint64_t ticks_per_us = delay_get_tick_rate() / 1000000;
+    TEST_ASSERT_TRUE((ticks_per_us == 1) || (ticks_per_us == 1000));
+
+    TEST_ASSERT_EQUAL(ticks_per_us * 1000, delay_us_to_ticks(1000));
+    TEST_ASSERT_EQUAL(1000, delay_ticks_to_us(ticks_per_us * 1000));
+    TEST_ASSERT_EQUAL(1000000, delay_ticks_to_ns(ticks_per_us * 1000));
+
+    // towards ticks: rounded up. From ticks: rounded down
+    TEST_ASSERT_EQUAL((ticks_per_us == 1) ? 2 : 1500, delay_ns_to_ticks(1500));
+    TEST_ASSERT_EQUAL(0, delay_ticks_to_us(ticks_per_us - 1));
+
+    // large values: (well) within the relative error of 1e-9
+    const uint64_t big = 0x123456789ABCULL;
+    const uint64_t big_us = delay_ticks_to_us(delay_us_to_ticks(big));
+    TEST_ASSERT_TRUE((big_us >= big) && (big_us <= (big + (big / 1000000000))));
+    const uint64_t big_ns = delay_ticks_to_ns(big * ticks_per_us);
+    TEST_ASSERT_TRUE((big_ns >= (big * 1000))
+            && (big_ns <= (big * 1000) + (big / 1000000)));
+
+    // timestamps differences are converted to microseconds
+    TEST_ASSERT_EQUAL(7, delay_calc_time_us(100, 100 + (7 * ticks_per_us)));
+}
+
+void test_timer_callback(void)
+{
+    delay_init();
+    g_called = 0;
+
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, 2000);
+    TEST_ASSERT_TRUE(delay_timer_schedule(timeout.target_timestamp,
+                timer_cb, NULL) >= 0);
+    TEST_ASSERT_EQUAL(0, g_called);
+
+    delay_timeout_t limit;
+    delay_timeout_set(&limit, 1000000);
+    while(!g_called && !delay_timeout_done(&limit)) {}
+
+    TEST_ASSERT_EQUAL(1, g_called);
+    TEST_ASSERT_TRUE(delay_timeout_done(&timeout));
+    TEST_ASSERT_EQUAL(0, delay_timer_count_scheduled());
+}
+
+// a deadline less than a microsecond away (full rate: ticks are ns)
+void test_timer_callback_sub_microsecond(void)
+{
+    delay_init();
+    g_called = 0;
+
+    const uint64_t deadline = delay_get_timestamp() + delay_ns_to_ticks(900);
+    TEST_ASSERT_TRUE(delay_timer_schedule(deadline, timer_cb, NULL) >= 0);
+
+    delay_timeout_t limit;
+    delay_timeout_set(&limit, 100000);
+    while(!g_called && !delay_timeout_done(&limit)) {}
+    TEST_ASSERT_EQUAL(1, g_called);
+}
+
+void test_timer_callback_deadline_passed(void)
+{
+    delay_init();
+    g_called = 0;
+
+    TEST_ASSERT_TRUE(delay_timer_schedule(0, timer_cb, NULL) >= 0);
+    TEST_ASSERT_EQUAL(1, g_called);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_timestamp_monotonic);
+    RUN_TEST(test_delay_us);
+    RUN_TEST(test_delay_us_sleep);
+    RUN_TEST(test_timestamp_coarse);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_timeout_at);
+    RUN_TEST(test_reinit);
+    RUN_TEST(test_tick_conversion);
+    RUN_TEST(test_timer_callback);
+    RUN_TEST(test_timer_callback_sub_microsecond);
+    RUN_TEST(test_timer_callback_deadline_passed);
+
+    UNITY_END();
+    return 0;
+}
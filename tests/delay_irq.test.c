@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+
+// Run the MCU timer code of delay.c against the fake timer of mocks/chip.h
+#undef MCU_PLATFORM_host
+#define MCU_PLATFORM_lpc11xxx
+#define DELAY_COARSE_PERIOD_MS (10)
+#include "delay.c"
+
+LPC_TIMER_T fake_timer;
+bool fake_irq_pending;
+uint32_t fake_clock_rate = 12000000;
+
+#define MATCH_ALARM     (1 << 0)
+#define MATCH_OVERFLOW  (1 << 1)
+#define MATCH_HALFWAY   (1 << 2)
+#define MATCH_COARSE    (1 << 3)
+
+// Move the timer to 'tc', then run the irq for the given match flags
+static void fire(uint32_t tc, uint32_t matches)
+{
+    fake_timer.TC = tc;
+    fake_timer.IR|= matches;
+    DELAY_IRQHandler();
+    TEST_ASSERT_EQUAL(0, fake_timer.IR);
+}
+
+void test_overflow_halfway(void)
+{
+    delay_init();
+
+    fire(0x80000000, MATCH_HALFWAY);
+    TEST_ASSERT_TRUE(delay_get_timestamp() == 0x80000000ULL);
+
+    // the timer overflows before the irq runs
+    fake_timer.TC = 5;
+    TEST_ASSERT_TRUE(delay_get_timestamp() == 0x100000005ULL);
+    fire(5, MATCH_OVERFLOW);
+    TEST_ASSERT_TRUE(delay_get_timestamp() == 0x100000005ULL);
+
+    fire(0x80000000, MATCH_HALFWAY);
+    TEST_ASSERT_TRUE(delay_get_timestamp() == 0x180000000ULL);
+}
+
+// an irq for the alarm only (or a software triggered one) must not publish
+// stale overflow info
+void test_alarm_between_overflow_and_halfway(void)
+{
+    delay_init();
+
+    const uint32_t steps[][2] = {
+        {0x80000000, MATCH_HALFWAY},
+        {0x00000010, MATCH_OVERFLOW},
+        {0x00000020, MATCH_ALARM},
+        {0x00000030, 0},
+        {0x80000000, MATCH_HALFWAY},
+        {0x80000010, MATCH_ALARM},
+        {0x00000000, MATCH_OVERFLOW},
+        {0x00000010, MATCH_ALARM},
+        {0x80000000, MATCH_HALFWAY},
+    };
+
+    uint64_t prev = delay_get_timestamp();
+    for(unsigned int i=0; i < (sizeof(steps) / sizeof(steps[0])); i++) {
+        fire(steps[i][0], steps[i][1]);
+
+        const uint64_t now = delay_get_timestamp();
+        TEST_ASSERT_TRUE(now >= prev);
+        prev = now;
+    }
+    TEST_ASSERT_TRUE(prev == 0x280000000ULL);
+}
+
+// The coarse time is behind the exact time in ms by less than a period
+static void assert_coarse_in_period(void)
+{
+    const uint64_t rate = delay_get_tick_rate();
+    const uint64_t exact_ms = (delay_get_timestamp() * 1000) / rate;
+    const uint32_t coarse_ms = delay_get_timestamp_coarse();
+    TEST_ASSERT_TRUE(coarse_ms <= exact_ms);
+    TEST_ASSERT_TRUE((exact_ms - coarse_ms) < DELAY_COARSE_PERIOD_MS);
+}
+
+// a period is 10416.66 ticks at 1041666 Hz: the fraction must not add up
+void test_coarse_non_integer_rate(void)
+{
+    fake_clock_rate = 12500000;
+    delay_init();
+    TEST_ASSERT_EQUAL(1041666, delay_get_tick_rate());
+
+    for(int i=0; i < 100000; i++) {
+        fire(fake_timer.MR[TIMER_COARSE_MATCH], MATCH_COARSE);
+        assert_coarse_in_period();
+    }
+    TEST_ASSERT_EQUAL(100000 * DELAY_COARSE_PERIOD_MS,
+            delay_get_timestamp_coarse());
+    fake_clock_rate = 12000000;
+}
+
+// an irq that is more than a period late catches up, instead of setting a
+// match that only triggers after the timer wraps
+void test_coarse_late_irq(void)
+{
+    delay_init();
+
+    const uint32_t match = fake_timer.MR[TIMER_COARSE_MATCH];
+    fire(match + 35000, MATCH_COARSE);
+    assert_coarse_in_period();
+    TEST_ASSERT_EQUAL(40, delay_get_timestamp_coarse());
+    TEST_ASSERT_EQUAL(50000, fake_timer.MR[TIMER_COARSE_MATCH]);
+
+    fire(fake_timer.MR[TIMER_COARSE_MATCH], MATCH_COARSE);
+    TEST_ASSERT_EQUAL(50, delay_get_timestamp_coarse());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_overflow_halfway);
+    RUN_TEST(test_alarm_between_overflow_and_halfway);
+    RUN_TEST(test_coarse_non_integer_rate);
+    RUN_TEST(test_coarse_late_irq);
+    return UNITY_END();
+}
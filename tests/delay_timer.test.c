@@ -0,0 +1,289 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "delay_timer.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+// Host backend for the delay_timer platform interface:
+// records what the hardware would be programmed to.
+static struct {
+    bool armed;
+    uint64_t deadline;
+    int arm_count;
+    bool locked;
+} g_platform;
+
+void delay_timer_platform_arm(uint64_t deadline)
+{
+    TEST_ASSERT_TRUE(g_platform.locked);
+    g_platform.armed = true;
+    g_platform.deadline = deadline;
+    g_platform.arm_count++;
+}
+
+void delay_timer_platform_disarm(void)
+{
+    g_platform.armed = false;
+}
+
+void delay_timer_platform_lock(void)
+{
+    TEST_ASSERT_FALSE(g_platform.locked);
+    g_platform.locked = true;
+}
+
+void delay_timer_platform_unlock(void)
+{
+    TEST_ASSERT_TRUE(g_platform.locked);
+    g_platform.locked = false;
+}
+
+// Advance the mock time and emulate the timer irq
+static void advance_micros(uint64_t micros)
+{
+    delay_mock_add_micros(micros);
+    if(g_platform.armed && (delay_get_timestamp() >= g_platform.deadline)) {
+        delay_timer_irq_handler();
+    }
+}
+
+static uint64_t deadline_in(uint64_t micros)
+{
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, micros);
+    return timeout.target_timestamp;
+}
+
+static int g_order[8];
+static int g_num_called;
+
+static void record_cb(void *ctx)
+{
+    g_order[g_num_called++] = (int)(intptr_t)ctx;
+}
+
+static void setup(void)
+{
+    memset(&g_platform, 0, sizeof(g_platform));
+    g_num_called = 0;
+    delay_mock_init();
+    delay_timer_init();
+}
+
+void test_earliest_deadline_programmed(void)
+{
+    setup();
+
+    TEST_ASSERT_FALSE(g_platform.armed);
+    TEST_ASSERT_TRUE(delay_timer_schedule(deadline_in(300), record_cb, (void*)3) >= 0);
+    TEST_ASSERT_TRUE(g_platform.armed);
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(300), g_platform.deadline);
+
+    TEST_ASSERT_TRUE(delay_timer_schedule(deadline_in(100), record_cb, (void*)1) >= 0);
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(100), g_platform.deadline);
+
+    // a later deadline does not re-program the hardware
+    const int arm_count = g_platform.arm_count;
+    TEST_ASSERT_TRUE(delay_timer_schedule(deadline_in(200), record_cb, (void*)2) >= 0);
+    TEST_ASSERT_EQUAL(arm_count, g_platform.arm_count);
+    TEST_ASSERT_EQUAL(3, delay_timer_count_scheduled());
+}
+
+void test_callbacks_in_deadline_order(void)
+{
+    setup();
+
+    delay_timer_schedule(deadline_in(300), record_cb, (void*)3);
+    delay_timer_schedule(deadline_in(100), record_cb, (void*)1);
+    delay_timer_schedule(deadline_in(200), record_cb, (void*)2);
+
+    advance_micros(99);
+    TEST_ASSERT_EQUAL(0, g_num_called);
+
+    advance_micros(1);
+    TEST_ASSERT_EQUAL(1, g_num_called);
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(100), g_platform.deadline);
+
+    // both remaining deadlines passed: called in order from one irq
+    advance_micros(500);
+    TEST_ASSERT_EQUAL(3, g_num_called);
+    TEST_ASSERT_EQUAL(1, g_order[0]);
+    TEST_ASSERT_EQUAL(2, g_order[1]);
+    TEST_ASSERT_EQUAL(3, g_order[2]);
+
+    TEST_ASSERT_FALSE(g_platform.armed);
+    TEST_ASSERT_EQUAL(0, delay_timer_count_scheduled());
+}
+
+void test_cancel(void)
+{
+    setup();
+
+    const int first = delay_timer_schedule(deadline_in(100), record_cb, (void*)1);
+    delay_timer_schedule(deadline_in(200), record_cb, (void*)2);
+
+    TEST_ASSERT_TRUE(delay_timer_cancel(first));
+    TEST_ASSERT_FALSE(delay_timer_cancel(first));
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(200), g_platform.deadline);
+
+    advance_micros(1000);
+    TEST_ASSERT_EQUAL(1, g_num_called);
+    TEST_ASSERT_EQUAL(2, g_order[0]);
+    TEST_ASSERT_FALSE(g_platform.armed);
+}
+
+// a stale handle should not cancel a new timer in the same slot
+void test_cancel_stale_handle(void)
+{
+    setup();
+
+    const int first = delay_timer_schedule(deadline_in(100), record_cb, (void*)1);
+    advance_micros(100);
+    TEST_ASSERT_EQUAL(1, g_num_called);
+
+    const int second = delay_timer_schedule(deadline_in(100), record_cb, (void*)2);
+    TEST_ASSERT_NOT_EQUAL(first, second);
+    TEST_ASSERT_FALSE(delay_timer_cancel(first));
+    TEST_ASSERT_EQUAL(1, delay_timer_count_scheduled());
+    TEST_ASSERT_TRUE(delay_timer_cancel(second));
+}
+
+void test_capacity(void)
+{
+    setup();
+
+    for(int i=0; i < DELAY_TIMER_MAX_SCHEDULED; i++) {
+        TEST_ASSERT_TRUE(delay_timer_schedule(deadline_in(100 + i), record_cb, 0) >= 0);
+    }
+    TEST_ASSERT_EQUAL(-1, delay_timer_schedule(deadline_in(100), record_cb, 0));
+    TEST_ASSERT_EQUAL(-1, delay_timer_schedule(deadline_in(100), NULL, 0));
+}
+
+static void reschedule_cb(void *ctx)
+{
+    const int remaining = (int)(intptr_t)ctx;
+    g_num_called++;
+    if(remaining) {
+        delay_timer_schedule(deadline_in(50), reschedule_cb,
+                (void*)(intptr_t)(remaining - 1));
+    }
+}
+
+// callbacks can schedule new callbacks (e.g. periodic timers)
+void test_reschedule_from_callback(void)
+{
+    setup();
+
+    delay_timer_schedule(deadline_in(50), reschedule_cb, (void*)2);
+    for(int i=0; i < 10; i++) {
+        advance_micros(50);
+    }
+    TEST_ASSERT_EQUAL(3, g_num_called);
+    TEST_ASSERT_FALSE(g_platform.armed);
+}
+
+static void past_deadline_cb(void *ctx)
+{
+    (void)ctx;
+    g_num_called++;
+    delay_timer_schedule(delay_get_timestamp() - 1, past_deadline_cb, 0);
+}
+
+// a callback that re-schedules itself in the past runs once per irq,
+// instead of keeping the irq handler busy forever
+void test_reschedule_in_past(void)
+{
+    setup();
+
+    delay_timer_schedule(deadline_in(50), past_deadline_cb, 0);
+    advance_micros(50);
+    TEST_ASSERT_EQUAL(1, g_num_called);
+    TEST_ASSERT_TRUE(g_platform.armed);
+    TEST_ASSERT_TRUE(g_platform.deadline < delay_get_timestamp());
+
+    delay_timer_irq_handler();
+    TEST_ASSERT_EQUAL(2, g_num_called);
+    TEST_ASSERT_EQUAL(1, delay_timer_count_scheduled());
+}
+
+// with slack, callbacks with overlapping windows share one wake-up
+void test_slack_coalescing(void)
+{
+    DelayTimerStats stats;
+    for(int slack=0; slack < 2; slack++) {
+        setup();
+        delay_timer_schedule_slack(deadline_in(190), slack * 100,
+                record_cb, (void*)3);
+        delay_timer_schedule_slack(deadline_in(100), slack * 100,
+                record_cb, (void*)1);
+        delay_timer_schedule_slack(deadline_in(150), slack * 100,
+                record_cb, (void*)2);
+
+        for(int i=0; i < 300; i++) {
+            advance_micros(1);
+        }
+        TEST_ASSERT_EQUAL(3, g_num_called);
+        TEST_ASSERT_EQUAL(1, g_order[0]);
+        TEST_ASSERT_EQUAL(2, g_order[1]);
+        TEST_ASSERT_EQUAL(3, g_order[2]);
+
+        delay_timer_get_stats(&stats);
+        TEST_ASSERT_EQUAL(3, stats.callbacks);
+        TEST_ASSERT_EQUAL(slack ? 1 : 3, stats.wakeups);
+    }
+}
+
+// the wake-up is never later than the window of any callback
+void test_slack_latest(void)
+{
+    setup();
+    delay_timer_schedule_slack(deadline_in(100), 500, record_cb, (void*)1);
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(600), g_platform.deadline);
+    delay_timer_schedule_slack(deadline_in(200), 50, record_cb, (void*)2);
+    TEST_ASSERT_EQUAL_UINT64(deadline_in(250), g_platform.deadline);
+
+    advance_micros(250);
+    TEST_ASSERT_EQUAL(2, g_num_called);
+    TEST_ASSERT_FALSE(g_platform.armed);
+}
+
+// the irq also runs for other timer events: those are not wake-ups
+void test_stats_other_irqs(void)
+{
+    DelayTimerStats stats;
+    setup();
+    delay_timer_schedule(deadline_in(100), record_cb, (void*)1);
+
+    delay_timer_irq_handler();
+    delay_timer_irq_handler();
+    delay_timer_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.wakeups);
+
+    advance_micros(100);
+    delay_timer_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.wakeups);
+    TEST_ASSERT_EQUAL(1, stats.callbacks);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_earliest_deadline_programmed);
+    RUN_TEST(test_callbacks_in_deadline_order);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_cancel_stale_handle);
+    RUN_TEST(test_capacity);
+    RUN_TEST(test_reschedule_from_callback);
+    RUN_TEST(test_reschedule_in_past);
+    RUN_TEST(test_slack_coalescing);
+    RUN_TEST(test_slack_latest);
+    RUN_TEST(test_stats_other_irqs);
+
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "gcra_limiter.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+// only allow one event every 10 sec (plus burst)
+void test_rate(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 1, 10*1e6, 4);
+    GcraLimiter limit;
+    gcra_limiter_init(&limit, &policy);
+
+    uint64_t wait_us;
+    TEST_ASSERT_EQUAL(4, gcra_limiter_count_available(&limit));
+    TEST_ASSERT_TRUE(gcra_limiter_allowed(&limit, 4, &wait_us));
+    TEST_ASSERT_EQUAL(0, wait_us);
+    TEST_ASSERT_FALSE(gcra_limiter_allowed(&limit, 1, &wait_us));
+    TEST_ASSERT_EQUAL(10*1e6, wait_us);
+
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_TRUE(gcra_limiter_allowed(&limit, 1, NULL));
+    TEST_ASSERT_FALSE(gcra_limiter_allowed(&limit, 1, NULL));
+
+    // the burst is limited, even if a lot of time passes
+    delay_mock_add_micros(1000*1e6);
+    TEST_ASSERT_EQUAL(4, gcra_limiter_count_available(&limit));
+    TEST_ASSERT_EQUAL(0, gcra_limiter_wait_us(&limit, 4));
+}
+
+// the reported wait time is exact
+void test_wait_exact(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 3, 1000, 5);
+    GcraLimiter limit;
+    gcra_limiter_init(&limit, &policy);
+
+    for(int i=0; i < 50; i++) {
+        uint64_t wait_us;
+        const unsigned int n = 1 + (i % 3);
+        if(gcra_limiter_allowed(&limit, n, &wait_us)) {
+            continue;
+        }
+        TEST_ASSERT_TRUE(wait_us > 0);
+        TEST_ASSERT_EQUAL(wait_us, gcra_limiter_wait_us(&limit, n));
+
+        delay_mock_add_micros(wait_us - 1);
+        TEST_ASSERT_FALSE(gcra_limiter_allowed(&limit, n, NULL));
+        delay_mock_add_micros(1);
+        TEST_ASSERT_TRUE(gcra_limiter_allowed(&limit, n, &wait_us));
+        TEST_ASSERT_EQUAL(0, wait_us);
+    }
+}
+
+// more than the burst size is never allowed
+void test_never(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 1, 1000, 4);
+    GcraLimiter limit;
+    gcra_limiter_init(&limit, &policy);
+
+    uint64_t wait_us;
+    TEST_ASSERT_FALSE(gcra_limiter_allowed(&limit, 5, &wait_us));
+    TEST_ASSERT_EQUAL(UINT64_MAX, wait_us);
+    TEST_ASSERT_EQUAL(UINT64_MAX, gcra_limiter_wait_us(&limit, 5));
+}
+
+// the state is only the TAT: limiters can share a policy
+void test_shared_policy(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 1, 1000, 2);
+    GcraLimiter a, b;
+    gcra_limiter_init(&a, &policy);
+    gcra_limiter_init(&b, &policy);
+
+    TEST_ASSERT_TRUE(gcra_limiter_allowed(&a, 2, NULL));
+    TEST_ASSERT_FALSE(gcra_limiter_allowed(&a, 1, NULL));
+    TEST_ASSERT_TRUE(gcra_limiter_allowed(&b, 2, NULL));
+}
+
+// a policy without any requests per interval never allows anything
+void test_no_requests(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 0, 1000, 4);
+    GcraLimiter limit;
+    gcra_limiter_init(&limit, &policy);
+
+    TEST_ASSERT_FALSE(gcra_limiter_allowed(&limit, 1, NULL));
+    TEST_ASSERT_EQUAL(UINT64_MAX, gcra_limiter_wait_us(&limit, 1));
+    TEST_ASSERT_EQUAL(0, gcra_limiter_count_available(&limit));
+}
+
+// the _at variant counts at the given time, not the current one
+void test_count_available_at(void)
+{
+    delay_mock_init();
+    TokenBucketPolicy policy;
+    token_bucket_policy_init(&policy, 1, 1000, 4);
+    GcraLimiter limit;
+    gcra_limiter_init(&limit, &policy);
+
+    const uint64_t start = delay_get_timestamp();
+    TEST_ASSERT_TRUE(gcra_limiter_allowed_at(&limit, 4, NULL, start));
+    TEST_ASSERT_EQUAL(0, gcra_limiter_count_available_at(&limit, start));
+    TEST_ASSERT_EQUAL(2, gcra_limiter_count_available_at(&limit,
+                start + delay_us_to_ticks(2000)));
+    TEST_ASSERT_EQUAL(0, gcra_limiter_count_available(&limit));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rate);
+    RUN_TEST(test_wait_exact);
+    RUN_TEST(test_never);
+    RUN_TEST(test_shared_policy);
+    RUN_TEST(test_no_requests);
+    RUN_TEST(test_count_available_at);
+    UNITY_END();
+    return 0;
+}
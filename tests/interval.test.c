@@ -0,0 +1,330 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "interval.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+static int count_a;
+static int count_b;
+static int count_c;
+
+static void cb_a(void) { count_a++; }
+static void cb_b(void) { count_b++; }
+static void cb_c(void) { count_c++; }
+
+static void reset_counts(void)
+{
+    count_a = 0;
+    count_b = 0;
+    count_c = 0;
+}
+
+// callbacks are due whenever the tick counter is a multiple of their time
+void test_interval_multiples(void)
+{
+    IntervalList list;
+    interval_init(&list);
+    reset_counts();
+
+    TEST_ASSERT_TRUE(interval_add(&list, 1, cb_a));
+    TEST_ASSERT_TRUE(interval_add(&list, 3, cb_b));
+    TEST_ASSERT_TRUE(interval_add(&list, 100, cb_c));
+
+    int expected_b = 0;
+    for(uint32_t t=1; t <= 1000; t++) {
+        interval_irq_handler(&list, t);
+        TEST_ASSERT_TRUE(interval_is_poll_required(&list));
+        interval_poll(&list);
+        TEST_ASSERT_FALSE(interval_is_poll_required(&list));
+
+        if(!(t % 3)) {
+            expected_b++;
+        }
+        TEST_ASSERT_EQUAL(t, count_a);
+        TEST_ASSERT_EQUAL(expected_b, count_b);
+        TEST_ASSERT_EQUAL(t / 100, count_c);
+    }
+}
+
+// the same time value twice counts as a single tick
+void test_interval_same_time_ignored(void)
+{
+    IntervalList list;
+    interval_init(&list);
+    reset_counts();
+
+    TEST_ASSERT_TRUE(interval_add(&list, 2, cb_a));
+
+    interval_irq_handler(&list, 5);
+    interval_irq_handler(&list, 5);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(0, count_a);
+
+    interval_irq_handler(&list, 6);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(1, count_a);
+}
+
+// intervals added later are still aligned to multiples of their time
+void test_interval_added_later(void)
+{
+    IntervalList list;
+    interval_init(&list);
+    reset_counts();
+
+    for(uint32_t t=1; t <= 7; t++) {
+        interval_irq_handler(&list, t);
+    }
+    TEST_ASSERT_TRUE(interval_add(&list, 5, cb_a));
+
+    for(uint32_t t=8; t <= 9; t++) {
+        interval_irq_handler(&list, t);
+    }
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(0, count_a);
+
+    interval_irq_handler(&list, 10);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(1, count_a);
+}
+
+void test_interval_capacity(void)
+{
+    IntervalList list;
+    interval_init(&list);
+
+    TEST_ASSERT_FALSE(interval_add(&list, 0, cb_a));
+    for(int i=0; i < MAX_INTERVALS; i++) {
+        TEST_ASSERT_TRUE(interval_add(&list, i+1, cb_a));
+    }
+    TEST_ASSERT_FALSE(interval_add(&list, 1, cb_a));
+}
+
+#if (INTERVAL_TICKLESS)
+// tickless: callbacks are due every 'time' microseconds after the first update
+void test_interval_tickless(void)
+{
+    IntervalList list;
+    delay_mock_init();
+    interval_init_tickless(&list);
+    reset_counts();
+
+    uint64_t deadline;
+    TEST_ASSERT_FALSE(interval_next_deadline(&list, &deadline));
+    TEST_ASSERT_TRUE(interval_add(&list, 1000, cb_a));
+    TEST_ASSERT_TRUE(interval_add(&list, 250, cb_b));
+
+    // not scheduled yet: update right away
+    TEST_ASSERT_TRUE(interval_next_deadline(&list, &deadline));
+    TEST_ASSERT_EQUAL(0, deadline);
+    interval_update(&list);
+    TEST_ASSERT_FALSE(interval_is_poll_required(&list));
+
+    // sleep until each deadline: no wake-ups in between
+    int wakeups = 0;
+    while(delay_calc_time_us(0, delay_get_timestamp()) < 10000) {
+        TEST_ASSERT_TRUE(interval_next_deadline(&list, &deadline));
+        TEST_ASSERT_TRUE(deadline > delay_get_timestamp());
+        delay_mock_add_micros(
+                delay_calc_time_us(delay_get_timestamp(), deadline));
+        interval_update(&list);
+        TEST_ASSERT_TRUE(interval_is_poll_required(&list));
+        interval_poll(&list);
+        wakeups++;
+    }
+    TEST_ASSERT_EQUAL(10, count_a);
+    TEST_ASSERT_EQUAL(40, count_b);
+    TEST_ASSERT_EQUAL(40, wakeups);
+
+    // the tick handler is not used
+    interval_irq_handler(&list, 1);
+    TEST_ASSERT_FALSE(interval_is_poll_required(&list));
+}
+
+// tickless: a late update keeps the phase, missed intervals are skipped
+void test_interval_tickless_late(void)
+{
+    IntervalList list;
+    delay_mock_init();
+    interval_init_tickless(&list);
+    reset_counts();
+
+    TEST_ASSERT_TRUE(interval_add(&list, 100, cb_a));
+    interval_update(&list);
+
+    delay_mock_add_micros(130);
+    interval_update(&list);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(1, count_a);
+
+    uint64_t deadline;
+    interval_next_deadline(&list, &deadline);
+    TEST_ASSERT_EQUAL(200, delay_calc_time_us(0, deadline));
+
+    delay_mock_add_micros(350);
+    interval_update(&list);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(2, count_a);
+    interval_next_deadline(&list, &deadline);
+    TEST_ASSERT_EQUAL(500, delay_calc_time_us(0, deadline));
+
+    // due at 200 and called at 480; the periods due at 300 and 400 are lost
+    TEST_ASSERT_EQUAL(2, list.intervals[0].missed);
+#if (INTERVAL_QUEUE)
+    TEST_ASSERT_EQUAL(280, list.intervals[0].last_latency);
+    TEST_ASSERT_EQUAL(280, list.intervals[0].max_latency);
+#endif
+}
+#endif
+
+// a slow poll: callbacks are not queued twice, but counted as missed
+void test_interval_overrun(void)
+{
+    IntervalList list;
+    interval_init(&list);
+    reset_counts();
+
+    TEST_ASSERT_TRUE(interval_add(&list, 1, cb_a));
+    TEST_ASSERT_TRUE(interval_add(&list, 2, cb_b));
+    for(uint32_t t=1; t <= 5; t++) {
+        interval_irq_handler(&list, t);
+    }
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(1, count_a);
+    TEST_ASSERT_EQUAL(1, count_b);
+    TEST_ASSERT_EQUAL(4, list.intervals[0].missed);
+    TEST_ASSERT_EQUAL(1, list.intervals[1].missed);
+
+#if (INTERVAL_QUEUE)
+    // latency in ticks: due at tick 1 and 2, called at tick 5
+    TEST_ASSERT_EQUAL(4, list.intervals[0].last_latency);
+    TEST_ASSERT_EQUAL(3, list.intervals[1].last_latency);
+#endif
+
+    interval_irq_handler(&list, 6);
+    interval_poll(&list);
+    TEST_ASSERT_EQUAL(2, count_a);
+    TEST_ASSERT_EQUAL(2, count_b);
+#if (INTERVAL_QUEUE)
+    TEST_ASSERT_EQUAL(0, list.intervals[0].last_latency);
+    TEST_ASSERT_EQUAL(4, list.intervals[0].max_latency);
+#endif
+    TEST_ASSERT_FALSE(interval_is_poll_required(&list));
+}
+
+static int count_slow;
+static void cb_slow(void)
+{
+    count_slow++;
+    delay_mock_add_micros(100);
+}
+
+// staggered: the same rates, but not all callbacks on the same tick
+void test_interval_stagger(void)
+{
+    const uint32_t times[5] = {2, 3, 4, 6, 12};
+    int max_per_tick[2];
+
+    for(int stagger=0; stagger < 2; stagger++) {
+        IntervalList list;
+        interval_init(&list);
+        interval_set_stagger(&list, stagger);
+        for(int i=0; i < 5; i++) {
+            TEST_ASSERT_TRUE(interval_add(&list, times[i], cb_slow));
+        }
+
+        count_slow = 0;
+        max_per_tick[stagger] = 0;
+        for(uint32_t t=1; t <= 1200; t++) {
+            const int before = count_slow;
+            interval_irq_handler(&list, t);
+            interval_poll(&list);
+            if((count_slow - before) > max_per_tick[stagger]) {
+                max_per_tick[stagger] = count_slow - before;
+            }
+            for(int i=0; i < 5; i++) {
+                TEST_ASSERT_EQUAL(0, list.intervals[i].missed);
+            }
+        }
+        TEST_ASSERT_EQUAL(600 + 400 + 300 + 200 + 100, count_slow);
+    }
+    TEST_ASSERT_EQUAL(5, max_per_tick[0]);
+    TEST_ASSERT_TRUE(max_per_tick[1] <= 3);
+}
+
+#if (INTERVAL_TICKLESS)
+// tickless stagger: the first callbacks are spread over the interval
+void test_interval_stagger_tickless(void)
+{
+    IntervalList list;
+    delay_mock_init();
+    interval_init_tickless(&list);
+    interval_set_stagger(&list, true);
+    for(int i=0; i < 4; i++) {
+        TEST_ASSERT_TRUE(interval_add(&list, 1000, cb_a));
+    }
+    TEST_ASSERT_EQUAL(0, list.intervals[0].offset);
+    for(int i=1; i < 4; i++) {
+        TEST_ASSERT_TRUE(list.intervals[i].offset < 1000);
+        for(int j=0; j < i; j++) {
+            const uint32_t a = list.intervals[i].offset;
+            const uint32_t b = list.intervals[j].offset;
+            TEST_ASSERT_TRUE(((a > b) ? (a - b) : (b - a)) >= 100);
+        }
+    }
+}
+#endif
+
+// a time budget per poll: the rest is carried over, in due order
+void test_interval_poll_budget(void)
+{
+    IntervalList list;
+    delay_mock_init();
+    interval_init(&list);
+    count_slow = 0;
+
+    for(int i=0; i < 3; i++) {
+        TEST_ASSERT_TRUE(interval_add(&list, 10, cb_slow));
+    }
+    for(uint32_t t=1; t <= 10; t++) {
+        interval_irq_handler(&list, t);
+    }
+
+    interval_poll_budget(&list, 150);
+    TEST_ASSERT_EQUAL(2, count_slow);
+    TEST_ASSERT_TRUE(interval_is_poll_required(&list));
+
+    // at least one callback, even without budget
+    interval_poll_budget(&list, 0);
+    TEST_ASSERT_EQUAL(3, count_slow);
+    interval_poll_budget(&list, 0);
+    TEST_ASSERT_EQUAL(3, count_slow);
+    TEST_ASSERT_FALSE(interval_is_poll_required(&list));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_interval_multiples);
+    RUN_TEST(test_interval_same_time_ignored);
+    RUN_TEST(test_interval_added_later);
+    RUN_TEST(test_interval_capacity);
+#if (INTERVAL_TICKLESS)
+    RUN_TEST(test_interval_tickless);
+    RUN_TEST(test_interval_tickless_late);
+#endif
+    RUN_TEST(test_interval_overrun);
+    RUN_TEST(test_interval_stagger);
+#if (INTERVAL_TICKLESS)
+    RUN_TEST(test_interval_stagger_tickless);
+#endif
+    RUN_TEST(test_interval_poll_budget);
+
+    UNITY_END();
+    return 0;
+}
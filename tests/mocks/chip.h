@@ -0,0 +1,68 @@
+#ifndef CHIP_H
+#define CHIP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Fake LPC chip library, to run the MCU code of delay.c on the host
+ * (see delay_irq.test.c). The timer does not count by itself: tests set TC
+ * and the pending match flags (IR), then call the irq handler.
+ */
+
+typedef struct {
+    volatile uint32_t TC;
+    uint32_t MR[4];
+    uint32_t IR;
+    uint32_t PR;
+} LPC_TIMER_T;
+
+extern LPC_TIMER_T fake_timer;
+extern bool fake_irq_pending;
+extern uint32_t fake_clock_rate;
+
+#define LPC_TIMER32_0   (&fake_timer)
+typedef enum { TIMER_32_0_IRQn } IRQn_Type;
+
+static inline uint32_t Chip_Clock_GetMainClockRate(void) { return fake_clock_rate; }
+
+static inline void Chip_TIMER_Init(LPC_TIMER_T *timer) {}
+static inline void Chip_TIMER_DeInit(LPC_TIMER_T *timer) {}
+static inline void Chip_TIMER_Enable(LPC_TIMER_T *timer) {}
+static inline void Chip_TIMER_Reset(LPC_TIMER_T *timer) { timer->TC = 0; }
+static inline void Chip_TIMER_PrescaleSet(LPC_TIMER_T *timer, uint32_t prescale)
+{
+    timer->PR = prescale;
+}
+static inline void Chip_TIMER_SetMatch(LPC_TIMER_T *timer, int8_t n,
+        uint32_t value)
+{
+    timer->MR[n] = value;
+}
+static inline void Chip_TIMER_MatchEnableInt(LPC_TIMER_T *timer, int8_t n) {}
+static inline void Chip_TIMER_MatchDisableInt(LPC_TIMER_T *timer, int8_t n) {}
+static inline void Chip_TIMER_ResetOnMatchDisable(LPC_TIMER_T *timer, int8_t n) {}
+static inline void Chip_TIMER_StopOnMatchDisable(LPC_TIMER_T *timer, int8_t n) {}
+static inline bool Chip_TIMER_MatchPending(LPC_TIMER_T *timer, int8_t n)
+{
+    return (timer->IR >> n) & 1;
+}
+static inline void Chip_TIMER_ClearMatch(LPC_TIMER_T *timer, int8_t n)
+{
+    timer->IR&= ~(1UL << n);
+}
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq) {}
+static inline void NVIC_DisableIRQ(IRQn_Type irq) {}
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq) { fake_irq_pending = false; }
+static inline void NVIC_SetPendingIRQ(IRQn_Type irq) { fake_irq_pending = true; }
+
+static inline void __DMB(void) {}
+static inline void __WFI(void) {}
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+// Pretend to run in an irq: delay_us_sleep() never sleeps
+static inline uint32_t __get_IPSR(void) { return 1; }
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+
+#endif
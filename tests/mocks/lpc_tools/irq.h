@@ -0,0 +1,6 @@
+#ifndef LPC_TOOLS_IRQ_H
+#define LPC_TOOLS_IRQ_H
+
+// Fake lpc_tools header, see chip.h
+
+#endif
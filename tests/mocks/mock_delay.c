@@ -28,20 +28,31 @@ uint64_t delay_get_timestamp()
     return g_state.time_3_us;
 }
 
-bool delay_timeout_done(delay_timeout_t *timeout)
+bool delay_timeout_done_at(delay_timeout_t *timeout, uint64_t now)
 {
     log_info("delay_timeout_done(): time is %u (%u) micros, target is %u",
-            g_state.time_3_us/3,
-            delay_get_timestamp(),
+            now/3,
+            now,
             timeout->target_timestamp);
-    bool done = (delay_get_timestamp() >= timeout->target_timestamp);
+    bool done = (now >= timeout->target_timestamp);
     log_info("done=%d", (int)done);
     return done;
 }
 
+bool delay_timeout_done(delay_timeout_t *timeout)
+{
+    return delay_timeout_done_at(timeout, delay_get_timestamp());
+}
+
+void delay_timeout_set_at(delay_timeout_t *timeout, uint64_t now,
+        uint64_t microseconds)
+{
+    timeout->target_timestamp = now + delay_us_to_ticks(microseconds);
+}
+
 void delay_timeout_set(delay_timeout_t *timeout, uint64_t microseconds)
 {
-    timeout->target_timestamp = g_state.time_3_us + 3*microseconds;
+    delay_timeout_set_at(timeout, g_state.time_3_us, microseconds);
 }
 
 uint64_t delay_calc_time_us(uint64_t start_timestamp, uint64_t end_timestamp)
@@ -53,3 +64,28 @@ uint64_t delay_calc_time_us(uint64_t start_timestamp, uint64_t end_timestamp)
     return (end_timestamp - start_timestamp) / 3;
 }
 
+uint32_t delay_get_tick_rate(void)
+{
+    return 3000000;
+}
+
+uint64_t delay_ticks_to_ns(uint64_t ticks)
+{
+    return (ticks * 1000) / 3;
+}
+
+uint64_t delay_ns_to_ticks(uint64_t nanoseconds)
+{
+    return ((nanoseconds * 3) + 999) / 1000;
+}
+
+uint64_t delay_ticks_to_us(uint64_t ticks)
+{
+    return ticks / 3;
+}
+
+uint64_t delay_us_to_ticks(uint64_t microseconds)
+{
+    return 3*microseconds;
+}
+
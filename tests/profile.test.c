@@ -5,6 +5,7 @@
 
 #include "unity.h"
 
+#define PROFILE_ENABLED 1
 #include "profile.h"
 
 int count = 0;
@@ -14,6 +15,11 @@ uint64_t delay_get_timestamp()
     return count++ *delay;
 }
 
+uint32_t delay_get_tick_rate(void)
+{
+    return 1000000;
+}
+
 void do_func()
 {
     int fcount = 0;
@@ -61,6 +67,213 @@ void test_profile()
 */
 }
 
+static void measure(Profile *prof, int duration)
+{
+    // The timestamp stub advances by 'delay' every call
+    delay = duration;
+    profile_start(prof);
+    profile_end(prof);
+}
+
+void test_profile_histogram(void)
+{
+    Profile prof;
+    profile_init(&prof, "histogram", 0);
+
+    // timestamp 0 means 'not started'
+    count = 1;
+
+    TEST_ASSERT_EQUAL(0, profile_get_percentile(&prof, 500));
+
+    for(int i=0; i < 990; i++) {
+        measure(&prof, 10);
+    }
+    for(int i=0; i < 9; i++) {
+        measure(&prof, 1000);
+    }
+    measure(&prof, 100000);
+    TEST_ASSERT_EQUAL(1000, profile_get_total_call_count(&prof));
+
+    // percentiles are accurate to 2^-PROFILE_HISTOGRAM_SUB_BITS
+    const uint64_t p50 = profile_get_percentile(&prof, 500);
+    TEST_ASSERT_TRUE((p50 >= 10) && (p50 <= 10 + (10 >> PROFILE_HISTOGRAM_SUB_BITS)));
+    TEST_ASSERT_EQUAL(p50, profile_get_percentile(&prof, 990));
+
+    const uint64_t p999 = profile_get_percentile(&prof, 999);
+    TEST_ASSERT_TRUE((p999 >= 1000) && (p999 <= 1000 + (1000 >> PROFILE_HISTOGRAM_SUB_BITS)));
+
+    // the highest percentile is limited to the actual max
+    TEST_ASSERT_EQUAL(100000, profile_get_percentile(&prof, 1000));
+
+    profile_reset(&prof);
+    TEST_ASSERT_EQUAL(0, profile_get_percentile(&prof, 500));
+}
+
+// durations beyond the histogram range are counted in the last bucket
+void test_profile_histogram_overflow(void)
+{
+    Profile prof;
+    profile_init(&prof, "overflow", 0);
+    count = 1;
+
+    measure(&prof, 1 << PROFILE_HISTOGRAM_MAX_BITS);
+    measure(&prof, 3 << PROFILE_HISTOGRAM_MAX_BITS);
+    TEST_ASSERT_EQUAL(PROFILE_HISTOGRAM_BUCKETS, sizeof(prof.histogram) / sizeof(prof.histogram[0]));
+    TEST_ASSERT_EQUAL(2, prof.histogram[PROFILE_HISTOGRAM_BUCKETS - 1]);
+    TEST_ASSERT_EQUAL(3 << PROFILE_HISTOGRAM_MAX_BITS,
+            profile_get_percentile(&prof, 1000));
+}
+
+static PROFILE_DEFINE(g_listed, "listed", 500);
+
+static void sampled_func(void)
+{
+    PROFILE_SAMPLED(16)
+}
+
+static void profiled_func(void)
+{
+    PROFILE
+}
+
+void test_profile_list(void)
+{
+    count = 1;
+    profiled_func();
+    profiled_func();
+
+    // g_listed and the PROFILE in profiled_func() and sampled_func()
+    Profile *list = NULL;
+    const int n = profile_get_data(&list);
+    TEST_ASSERT_EQUAL(3, n);
+    TEST_ASSERT_EQUAL(3, profile_list_size());
+
+    Profile *func_prof = NULL;
+    for(int i=0; i < n; i++) {
+        TEST_ASSERT_EQUAL(i, profile_get_index(&list[i]));
+        if(!strcmp(list[i].label, "profiled_func")) {
+            func_prof = &list[i];
+        }
+    }
+    TEST_ASSERT_NOT_NULL(func_prof);
+    TEST_ASSERT_EQUAL(2, profile_get_total_call_count(func_prof));
+
+    TEST_ASSERT_EQUAL(500, g_listed.threshold);
+    TEST_ASSERT_EQUAL_STRING("listed", g_listed.label);
+
+    // runtime-initialized profiles still work, but are not listed
+    Profile prof;
+    profile_init(&prof, "unlisted", 0);
+    TEST_ASSERT_EQUAL(-1, profile_get_index(&prof));
+    TEST_ASSERT_EQUAL(3, profile_list_size());
+}
+
+void test_profile_calibrate(void)
+{
+    Profile prof;
+    profile_init(&prof, "calibrate", 250);
+    count = 1;
+
+    // the stub advances 'delay' ticks per timestamp: that is the overhead
+    delay = 100;
+    TEST_ASSERT_EQUAL(0, profile_get_overhead());
+    TEST_ASSERT_EQUAL(100, profile_calibrate());
+    TEST_ASSERT_EQUAL(100, profile_get_overhead());
+
+    measure(&prof, 300);
+    TEST_ASSERT_EQUAL(200, profile_get_max(&prof));
+    TEST_ASSERT_EQUAL(0, profile_get_threshold_count(&prof));
+
+    // saturates at 0
+    measure(&prof, 50);
+    TEST_ASSERT_EQUAL(200, prof.ticks);
+    TEST_ASSERT_EQUAL(2, profile_get_total_call_count(&prof));
+
+    profile_set_compensation(false);
+    measure(&prof, 300);
+    TEST_ASSERT_EQUAL(300, profile_get_max(&prof));
+    TEST_ASSERT_EQUAL(1, profile_get_threshold_count(&prof));
+    TEST_ASSERT_EQUAL(100, profile_get_overhead());
+}
+
+void test_profile_sampling(void)
+{
+    Profile prof;
+    profile_init(&prof, "sampled", 50);
+    profile_set_sampling(&prof, 4, false);
+    count = 1;
+
+    // every 4th call is timed, starting with the first
+    for(int i=0; i < 8; i++) {
+        measure(&prof, 100);
+    }
+    TEST_ASSERT_EQUAL(8, profile_get_total_call_count(&prof));
+    TEST_ASSERT_EQUAL(2, prof.sample_count);
+    TEST_ASSERT_EQUAL(100, profile_get_average(&prof));
+
+    // both timed calls exceeded the threshold: extrapolated to all calls
+    TEST_ASSERT_EQUAL(2, prof.threshold_call_count);
+    TEST_ASSERT_EQUAL(8, profile_get_threshold_count(&prof));
+}
+
+void test_profile_sampling_random(void)
+{
+    Profile prof;
+    profile_init(&prof, "random", 0);
+    profile_set_sampling(&prof, 8, true);
+    count = 1;
+
+    for(int i=0; i < 8000; i++) {
+        measure(&prof, 10);
+    }
+    TEST_ASSERT_EQUAL(8000, profile_get_total_call_count(&prof));
+    TEST_ASSERT_TRUE((prof.sample_count > 800) && (prof.sample_count < 1200));
+    TEST_ASSERT_EQUAL(10, profile_get_average(&prof));
+}
+
+void test_profile_sampled_macro(void)
+{
+    count = 1;
+    for(int i=0; i < 32; i++) {
+        sampled_func();
+    }
+
+    Profile *list = NULL;
+    const int n = profile_get_data(&list);
+    for(int i=0; i < n; i++) {
+        if(!strcmp(list[i].label, "sampled_func")) {
+            TEST_ASSERT_EQUAL(32, list[i].call_count);
+            TEST_ASSERT_EQUAL(2, list[i].sample_count);
+            return;
+        }
+    }
+    TEST_FAIL();
+}
+
+// explicit timestamps: the timer is not read
+void test_profile_at(void)
+{
+    Profile a, b;
+    profile_init(&a, "phase a", 0);
+    profile_init(&b, "phase b", 0);
+    profile_set_compensation(false);
+    count = 1;
+
+    profile_start_at(&a, 1000);
+    profile_end_at(&a, 1400);
+    profile_start_at(&b, 1400);
+    profile_end_at(&b, 1500);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(400, profile_get_max(&a));
+    TEST_ASSERT_EQUAL(100, profile_get_max(&b));
+
+    // a timestamp before the start counts as 0
+    profile_start_at(&b, 2000);
+    profile_end_at(&b, 1900);
+    TEST_ASSERT_EQUAL(2, profile_get_total_call_count(&b));
+    TEST_ASSERT_EQUAL(100, b.ticks);
+}
+
 void test_dummy(void)
 {
     printf("Hi from test_dummy()\n");
@@ -70,6 +283,14 @@ int main(void)
 {
     UNITY_BEGIN();
     RUN_TEST(test_profile);
+    RUN_TEST(test_profile_histogram);
+    RUN_TEST(test_profile_histogram_overflow);
+    RUN_TEST(test_profile_list);
+    RUN_TEST(test_profile_calibrate);
+    RUN_TEST(test_profile_sampling);
+    RUN_TEST(test_profile_sampling_random);
+    RUN_TEST(test_profile_sampled_macro);
+    RUN_TEST(test_profile_at);
     RUN_TEST(test_dummy);
     UNITY_END();
     return 0;
@@ -0,0 +1,158 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "profile.h"
+#include "profile_calltree.h"
+
+static uint64_t g_now = 1;
+uint64_t delay_get_timestamp(void)
+{
+    return g_now;
+}
+
+uint32_t delay_get_tick_rate(void)
+{
+    return 1000000;
+}
+
+static char g_folded[1024];
+static uint32_t g_folded_size;
+
+static void folded_sink(void *ctx, const void *data, uint32_t size)
+{
+    TEST_ASSERT_TRUE(g_folded_size + size < sizeof(g_folded));
+    memcpy(&g_folded[g_folded_size], data, size);
+    g_folded_size+= size;
+    g_folded[g_folded_size] = '\0';
+}
+
+static const char *dump_folded(void)
+{
+    g_folded_size = 0;
+    g_folded[0] = '\0';
+    profile_calltree_dump_folded(folded_sink, NULL);
+    return g_folded;
+}
+
+static PROFILE_DEFINE(g_prof_a, "a", 0);
+static PROFILE_DEFINE(g_prof_b, "b", 0);
+static PROFILE_DEFINE(g_prof_c, "c", 0);
+
+static void start_at(Profile *prof, uint64_t now)
+{
+    g_now = now;
+    profile_start(prof);
+}
+
+static void end_at(Profile *prof, uint64_t now)
+{
+    g_now = now;
+    profile_end(prof);
+}
+
+void setUp(void)
+{
+    profile_calltree_reset();
+}
+
+void tearDown(void) {}
+
+void test_profile_calltree_self_time(void)
+{
+    start_at(&g_prof_a, 100);
+    start_at(&g_prof_b, 110);
+    end_at(&g_prof_b, 130);
+    start_at(&g_prof_c, 140);
+    start_at(&g_prof_b, 150);
+    end_at(&g_prof_b, 155);
+    end_at(&g_prof_c, 170);
+    end_at(&g_prof_a, 200);
+
+    const ProfileCallTreeNode *nodes;
+    TEST_ASSERT_EQUAL(4, profile_calltree_get_nodes(PROFILE_CALLTREE_THREAD,
+                &nodes));
+    TEST_ASSERT_EQUAL(0, profile_calltree_get_nodes(PROFILE_CALLTREE_HANDLER,
+                &nodes));
+
+    // a: 100 inclusive, of which 20 in b and 30 in c (which spent 5 in b)
+    TEST_ASSERT_EQUAL_STRING("a 50\na;b 20\na;c 25\na;c;b 5\n", dump_folded());
+
+    profile_calltree_get_nodes(PROFILE_CALLTREE_THREAD, &nodes);
+    TEST_ASSERT_EQUAL(PROFILE_CALLTREE_ROOT, nodes[0].parent);
+    TEST_ASSERT_EQUAL(100, nodes[0].inclusive_ticks);
+    TEST_ASSERT_EQUAL(30, nodes[2].inclusive_ticks);
+
+    // the same path again is added to the same node
+    start_at(&g_prof_a, 300);
+    start_at(&g_prof_b, 301);
+    end_at(&g_prof_b, 303);
+    end_at(&g_prof_a, 310);
+    TEST_ASSERT_EQUAL(4, profile_calltree_get_nodes(PROFILE_CALLTREE_THREAD,
+                &nodes));
+    TEST_ASSERT_EQUAL(2, nodes[1].call_count);
+    TEST_ASSERT_EQUAL(22, nodes[1].self_ticks);
+    TEST_ASSERT_EQUAL(58, nodes[0].self_ticks);
+    TEST_ASSERT_EQUAL(0, profile_calltree_get_dropped());
+}
+
+void test_profile_calltree_missing_end(void)
+{
+    start_at(&g_prof_a, 100);
+    start_at(&g_prof_b, 110);
+    // b never ends: it is closed when its parent ends
+    end_at(&g_prof_a, 150);
+
+    start_at(&g_prof_c, 200);
+    end_at(&g_prof_c, 210);
+
+    TEST_ASSERT_EQUAL_STRING("a 50\na;b 0\nc 10\n", dump_folded());
+}
+
+#define TOO_DEEP (PROFILE_CALLTREE_DEPTH + 4)
+static Profile g_deep[TOO_DEEP];
+
+static void recurse(unsigned int depth)
+{
+    profile_start(&g_deep[depth]);
+    if(depth < (TOO_DEEP - 1)) {
+        recurse(depth + 1);
+    }
+    profile_end(&g_deep[depth]);
+}
+
+void test_profile_calltree_too_deep(void)
+{
+    for(int i=0; i < TOO_DEEP; i++) {
+        profile_init(&g_deep[i], "deep", 0);
+    }
+    g_now = 100;
+    recurse(0);
+
+    const ProfileCallTreeNode *nodes;
+    TEST_ASSERT_EQUAL(PROFILE_CALLTREE_DEPTH,
+            profile_calltree_get_nodes(PROFILE_CALLTREE_THREAD, &nodes));
+    TEST_ASSERT_EQUAL(4, profile_calltree_get_dropped());
+    TEST_ASSERT_EQUAL(1, nodes[PROFILE_CALLTREE_DEPTH - 1].call_count);
+
+    // the stack is balanced again afterwards
+    start_at(&g_prof_b, 200);
+    end_at(&g_prof_b, 201);
+    TEST_ASSERT_EQUAL(PROFILE_CALLTREE_DEPTH + 1,
+            profile_calltree_get_nodes(PROFILE_CALLTREE_THREAD, &nodes));
+    TEST_ASSERT_EQUAL(PROFILE_CALLTREE_ROOT,
+            nodes[PROFILE_CALLTREE_DEPTH].parent);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_profile_calltree_self_time);
+    RUN_TEST(test_profile_calltree_missing_end);
+    RUN_TEST(test_profile_calltree_too_deep);
+    UNITY_END();
+    return 0;
+}
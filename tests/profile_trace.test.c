@@ -0,0 +1,224 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "profile.h"
+#include "profile_trace.h"
+
+static uint64_t g_now = 1;
+uint64_t delay_get_timestamp(void)
+{
+    return g_now;
+}
+
+uint32_t delay_get_tick_rate(void)
+{
+    return 204000000;
+}
+
+static uint8_t g_dump[8192];
+static uint32_t g_dump_size;
+
+static void dump_sink(void *ctx, const void *data, uint32_t size)
+{
+    TEST_ASSERT_TRUE(g_dump_size + size <= sizeof(g_dump));
+    memcpy(&g_dump[g_dump_size], data, size);
+    g_dump_size+= size;
+}
+
+static ProfileTraceHeader *dump(void)
+{
+    g_dump_size = 0;
+    profile_trace_dump(dump_sink, NULL);
+    return (ProfileTraceHeader *)g_dump;
+}
+
+static uint32_t *dump_records(void)
+{
+    return (uint32_t *)&g_dump[sizeof(ProfileTraceHeader)];
+}
+
+typedef struct {
+    uint16_t index;
+    bool end;
+    uint64_t timestamp;
+} Event;
+
+// Reference decoder, see tools/profile_trace_to_json.py
+static int decode(const uint32_t *records, uint32_t num_records,
+        Event *events)
+{
+    const uint32_t time_mask = (1UL << PROFILE_TRACE_TIME_BITS) - 1;
+    int num_events = 0;
+    bool synced = false;
+    bool have_sync = false;
+    uint64_t sync_high = 0;
+    uint64_t timestamp = 0;
+
+    for(uint32_t i=0; i < num_records; i++) {
+        const uint32_t index = records[i] >> PROFILE_TRACE_INDEX_SHIFT;
+        if(index == PROFILE_TRACE_SYNC) {
+            sync_high = records[i] & ((1UL << PROFILE_TRACE_INDEX_SHIFT) - 1);
+            have_sync = true;
+            continue;
+        }
+        const uint32_t low = records[i] & time_mask;
+        if(have_sync) {
+            timestamp = (sync_high << PROFILE_TRACE_TIME_BITS) | low;
+            have_sync = false;
+            synced = true;
+        } else if(synced) {
+            int32_t delta = (low - timestamp) & time_mask;
+            if(delta >= (1L << (PROFILE_TRACE_TIME_BITS - 1))) {
+                delta-= (1L << PROFILE_TRACE_TIME_BITS);
+            }
+            timestamp+= delta;
+        } else {
+            continue;
+        }
+        events[num_events].index = index;
+        events[num_events].end = !!(records[i] & PROFILE_TRACE_END_BIT);
+        events[num_events].timestamp = timestamp;
+        num_events++;
+    }
+    return num_events;
+}
+
+static PROFILE_DEFINE(g_prof_a, "a", 0);
+static PROFILE_DEFINE(g_prof_b, "b", 0);
+
+void setUp(void)
+{
+    profile_trace_clear();
+    profile_trace_enable(true);
+}
+
+void tearDown(void) {}
+
+void test_profile_trace_events(void)
+{
+    g_now = 1000;
+    profile_start(&g_prof_a);
+    g_now = 1010;
+    profile_start(&g_prof_b);
+    g_now = 1025;
+    profile_end(&g_prof_b);
+    g_now = 1100;
+    profile_end(&g_prof_a);
+
+    ProfileTraceHeader *header = dump();
+    TEST_ASSERT_EQUAL_HEX32(PROFILE_TRACE_MAGIC, header->magic);
+    TEST_ASSERT_EQUAL(PROFILE_TRACE_VERSION, header->version);
+    TEST_ASSERT_EQUAL(204000000, header->ticks_per_second);
+    TEST_ASSERT_EQUAL(2, header->num_labels);
+
+    // a trace always starts with a sync record
+    TEST_ASSERT_EQUAL(5, header->num_records);
+    TEST_ASSERT_EQUAL(PROFILE_TRACE_SYNC,
+            dump_records()[0] >> PROFILE_TRACE_INDEX_SHIFT);
+
+    Event events[4];
+    TEST_ASSERT_EQUAL(4, decode(dump_records(), header->num_records, events));
+    const Event expected[] = {
+        {0, false, 1000}, {1, false, 1010}, {1, true, 1025}, {0, true, 1100},
+    };
+    for(int i=0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(expected[i].index, events[i].index);
+        TEST_ASSERT_EQUAL(expected[i].end, events[i].end);
+        TEST_ASSERT_EQUAL(expected[i].timestamp, events[i].timestamp);
+    }
+
+    // labels follow the records
+    const uint8_t *labels = (uint8_t *)&dump_records()[header->num_records];
+    uint16_t length;
+    memcpy(&length, labels, sizeof(length));
+    TEST_ASSERT_EQUAL(1, length);
+    TEST_ASSERT_EQUAL('a', labels[2]);
+    memcpy(&length, labels + 3, sizeof(length));
+    TEST_ASSERT_EQUAL(1, length);
+    TEST_ASSERT_EQUAL('b', labels[5]);
+}
+
+void test_profile_trace_long_gap(void)
+{
+    g_now = 10;
+    profile_start(&g_prof_a);
+    // too long for the low timestamp bits: a sync record is inserted
+    g_now = 10 + (5ULL << PROFILE_TRACE_TIME_BITS);
+    profile_end(&g_prof_a);
+
+    ProfileTraceHeader *header = dump();
+    TEST_ASSERT_EQUAL(4, header->num_records);
+
+    Event events[2];
+    TEST_ASSERT_EQUAL(2, decode(dump_records(), header->num_records, events));
+    TEST_ASSERT_EQUAL(10, events[0].timestamp);
+    TEST_ASSERT_EQUAL(10 + (5ULL << PROFILE_TRACE_TIME_BITS), events[1].timestamp);
+}
+
+// a sync record holds timestamp bits 42..21: bit 42 must not get lost
+void test_profile_trace_sync_high_bits(void)
+{
+    g_now = (1ULL << 42) + 5;
+    profile_start(&g_prof_a);
+    g_now+= 10;
+    profile_end(&g_prof_a);
+
+    ProfileTraceHeader *header = dump();
+    Event events[2];
+    TEST_ASSERT_EQUAL(2, decode(dump_records(), header->num_records, events));
+    TEST_ASSERT_TRUE(events[0].timestamp == (1ULL << 42) + 5);
+    TEST_ASSERT_TRUE(events[1].timestamp == (1ULL << 42) + 15);
+}
+
+void test_profile_trace_wrap(void)
+{
+    // fill the buffer a few times: only the newest records are kept
+    g_now = 1ULL << 40;
+    const int num_calls = 2 * PROFILE_TRACE_SIZE;
+    for(int i=0; i < num_calls; i++) {
+        profile_start(&g_prof_a);
+        g_now+= 3;
+        profile_end(&g_prof_a);
+        g_now+= 7;
+    }
+
+    ProfileTraceHeader *header = dump();
+    TEST_ASSERT_EQUAL(PROFILE_TRACE_SIZE, header->num_records);
+
+    static Event events[PROFILE_TRACE_SIZE];
+    const int n = decode(dump_records(), header->num_records, events);
+
+    // the decoder can always recover from a sync record in the first quarter
+    TEST_ASSERT_TRUE(n > (PROFILE_TRACE_SIZE / 2));
+    TEST_ASSERT_EQUAL(g_now - 7, events[n-1].timestamp);
+    TEST_ASSERT_TRUE(events[n-1].end);
+    for(int i=1; i < n; i++) {
+        TEST_ASSERT_EQUAL(events[i-1].end ? 7 : 3,
+                events[i].timestamp - events[i-1].timestamp);
+        TEST_ASSERT_NOT_EQUAL(events[i-1].end, events[i].end);
+    }
+}
+
+void test_profile_trace_disabled(void)
+{
+    profile_trace_enable(false);
+    profile_start(&g_prof_a);
+    profile_end(&g_prof_a);
+    TEST_ASSERT_EQUAL(0, dump()->num_records);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_profile_trace_events);
+    RUN_TEST(test_profile_trace_long_gap);
+    RUN_TEST(test_profile_trace_sync_high_bits);
+    RUN_TEST(test_profile_trace_wrap);
+    RUN_TEST(test_profile_trace_disabled);
+    UNITY_END();
+    return 0;
+}
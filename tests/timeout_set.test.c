@@ -0,0 +1,146 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "timeout_set.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+static TimeoutSet g_set;
+
+void setUp(void)
+{
+    delay_mock_init();
+    timeout_set_init(&g_set);
+}
+
+void tearDown(void) {}
+
+// expired timeouts are returned in order, and removed from the set
+void test_expired_in_order(void)
+{
+    uint16_t ids[TIMEOUT_SET_MAX];
+    TEST_ASSERT_TRUE(timeout_set_arm(&g_set, 3, 300));
+    TEST_ASSERT_TRUE(timeout_set_arm(&g_set, 1, 100));
+    TEST_ASSERT_TRUE(timeout_set_arm(&g_set, 2, 200));
+    TEST_ASSERT_FALSE(timeout_set_arm(&g_set, TIMEOUT_SET_MAX, 100));
+
+    TEST_ASSERT_EQUAL(0, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    delay_mock_add_micros(250);
+    TEST_ASSERT_EQUAL(2, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    TEST_ASSERT_EQUAL(1, ids[0]);
+    TEST_ASSERT_EQUAL(2, ids[1]);
+    TEST_ASSERT_FALSE(timeout_set_is_armed(&g_set, 1));
+    TEST_ASSERT_TRUE(timeout_set_is_armed(&g_set, 3));
+
+    delay_mock_add_micros(50);
+    TEST_ASSERT_EQUAL(1, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    TEST_ASSERT_EQUAL(3, ids[0]);
+    TEST_ASSERT_EQUAL(0, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+}
+
+// the expiry matches a delay_timeout_t set at the same time
+void test_same_as_delay_timeout(void)
+{
+    uint16_t ids[1];
+    delay_timeout_t timeout;
+    delay_timeout_set(&timeout, 100);
+    timeout_set_arm(&g_set, 0, 100);
+
+    delay_mock_add_micros(99);
+    TEST_ASSERT_FALSE(delay_timeout_done(&timeout));
+    TEST_ASSERT_EQUAL(0, timeout_set_expired(&g_set, ids, 1));
+    delay_mock_add_micros(1);
+    TEST_ASSERT_TRUE(delay_timeout_done(&timeout));
+    TEST_ASSERT_EQUAL(1, timeout_set_expired(&g_set, ids, 1));
+}
+
+// re-arm and cancel
+void test_rearm_cancel(void)
+{
+    uint16_t ids[TIMEOUT_SET_MAX];
+    timeout_set_arm(&g_set, 0, 100);
+    timeout_set_arm(&g_set, 1, 200);
+    timeout_set_arm(&g_set, 0, 300);
+    TEST_ASSERT_TRUE(timeout_set_cancel(&g_set, 1));
+    TEST_ASSERT_FALSE(timeout_set_cancel(&g_set, 1));
+
+    delay_mock_add_micros(250);
+    TEST_ASSERT_EQUAL(0, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    delay_mock_add_micros(50);
+    TEST_ASSERT_EQUAL(1, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    TEST_ASSERT_EQUAL(0, ids[0]);
+}
+
+// the earliest expiry, for sleep decisions
+void test_next_expiry(void)
+{
+    uint64_t timestamp;
+    TEST_ASSERT_EQUAL(DEADLINE_HEAP_NONE,
+            timeout_set_next_expiry(&g_set, &timestamp));
+    TEST_ASSERT_EQUAL(UINT64_MAX, timeout_set_next_expiry_us(&g_set));
+
+    timeout_set_arm(&g_set, 5, 500);
+    timeout_set_arm(&g_set, 7, 70);
+    TEST_ASSERT_EQUAL(7, timeout_set_next_expiry(&g_set, &timestamp));
+    TEST_ASSERT_EQUAL(70, timeout_set_next_expiry_us(&g_set));
+
+    delay_mock_add_micros(100);
+    TEST_ASSERT_EQUAL(0, timeout_set_next_expiry_us(&g_set));
+}
+
+// a small output array: the rest is returned by the next call
+void test_expired_max(void)
+{
+    uint16_t ids[2];
+    const uint64_t now = delay_get_timestamp();
+    for(uint16_t i=0; i < 5; i++) {
+        timeout_set_arm_at(&g_set, i, now, 10 * i);
+    }
+    delay_mock_add_micros(100);
+    TEST_ASSERT_EQUAL(2, timeout_set_expired(&g_set, ids, 2));
+    TEST_ASSERT_EQUAL(2, timeout_set_expired(&g_set, ids, 2));
+    TEST_ASSERT_EQUAL(1, timeout_set_expired(&g_set, ids, 2));
+    TEST_ASSERT_EQUAL(4, ids[0]);
+}
+
+// slack: wake up once for timeouts with overlapping windows
+void test_next_wakeup_slack(void)
+{
+    uint16_t ids[TIMEOUT_SET_MAX];
+    uint64_t wakeup;
+    const uint64_t now = delay_get_timestamp();
+    TEST_ASSERT_FALSE(timeout_set_next_wakeup(&g_set, &wakeup));
+
+    timeout_set_arm_slack_at(&g_set, 0, now, 100, 100);
+    timeout_set_arm_slack_at(&g_set, 1, now, 150, 100);
+    timeout_set_arm_slack_at(&g_set, 2, now, 400, 0);
+    TEST_ASSERT_TRUE(timeout_set_next_wakeup(&g_set, &wakeup));
+    TEST_ASSERT_EQUAL(200, delay_calc_time_us(now, wakeup));
+
+    delay_mock_add_micros(200);
+    TEST_ASSERT_EQUAL(2, timeout_set_expired(&g_set, ids, TIMEOUT_SET_MAX));
+    TEST_ASSERT_TRUE(timeout_set_next_wakeup(&g_set, &wakeup));
+    TEST_ASSERT_EQUAL(400, delay_calc_time_us(now, wakeup));
+
+    // without slack, the wake-up is the expiry
+    timeout_set_arm_at(&g_set, 3, now, 300);
+    TEST_ASSERT_TRUE(timeout_set_next_wakeup(&g_set, &wakeup));
+    TEST_ASSERT_EQUAL(300, delay_calc_time_us(now, wakeup));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_expired_in_order);
+    RUN_TEST(test_same_as_delay_timeout);
+    RUN_TEST(test_rearm_cancel);
+    RUN_TEST(test_next_expiry);
+    RUN_TEST(test_expired_max);
+    RUN_TEST(test_next_wakeup_slack);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "timer_wheel.h"
+
+#define NUM_ENTRIES 8
+
+static TimerWheel wheel;
+static TimerWheelEntry entries[NUM_ENTRIES];
+
+// advance the wheel until 'index' expires, return the amount of ticks
+static uint32_t ticks_until_expired(uint16_t index, uint32_t max_ticks)
+{
+    for(uint32_t t=1; t <= max_ticks; t++) {
+        timer_wheel_tick(&wheel);
+        uint16_t expired = timer_wheel_pop_expired(&wheel);
+        if(expired != TIMER_WHEEL_NONE) {
+            TEST_ASSERT_EQUAL(index, expired);
+            TEST_ASSERT_EQUAL(TIMER_WHEEL_NONE,
+                    timer_wheel_pop_expired(&wheel));
+            return t;
+        }
+    }
+    return 0;
+}
+
+void test_expire_exact(void)
+{
+    const uint32_t delays[] = {1, 2, 15, 16, 17, 255, 256, 257, 4095,
+        4096, 70000, 1000000};
+
+    for(size_t i=0; i < sizeof(delays)/sizeof(delays[0]); i++) {
+        // start at an arbitrary offset to test wrapping of lower levels
+        timer_wheel_init(&wheel, entries, NUM_ENTRIES, 12345 + i*77);
+        TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 3, delays[i]));
+        TEST_ASSERT_EQUAL(delays[i], ticks_until_expired(3, delays[i] + 10));
+        TEST_ASSERT_FALSE(timer_wheel_is_armed(&wheel, 3));
+    }
+}
+
+void test_expire_across_32bit_wrap(void)
+{
+    timer_wheel_init(&wheel, entries, NUM_ENTRIES, 0xFFFFFF00);
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 0, 0x200));
+    TEST_ASSERT_EQUAL(0x200, ticks_until_expired(0, 0x300));
+}
+
+void test_cancel(void)
+{
+    timer_wheel_init(&wheel, entries, NUM_ENTRIES, 0);
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 0, 10));
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 1, 10));
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 2, 10));
+    timer_wheel_cancel(&wheel, 1);
+    TEST_ASSERT_FALSE(timer_wheel_is_armed(&wheel, 1));
+
+    // cancelling twice is harmless
+    timer_wheel_cancel(&wheel, 1);
+
+    for(int t=0; t < 10; t++) {
+        timer_wheel_tick(&wheel);
+    }
+    bool seen[NUM_ENTRIES] = {false};
+    uint16_t index;
+    int count = 0;
+    while((index = timer_wheel_pop_expired(&wheel)) != TIMER_WHEEL_NONE) {
+        seen[index] = true;
+        count++;
+    }
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_TRUE(seen[0]);
+    TEST_ASSERT_FALSE(seen[1]);
+    TEST_ASSERT_TRUE(seen[2]);
+}
+
+void test_rearm_moves_timer(void)
+{
+    timer_wheel_init(&wheel, entries, NUM_ENTRIES, 0);
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 5, 1000));
+    TEST_ASSERT_TRUE(timer_wheel_add(&wheel, 5, 20));
+    TEST_ASSERT_EQUAL(20, ticks_until_expired(5, 2000));
+    TEST_ASSERT_EQUAL(0, ticks_until_expired(5, 2000));
+}
+
+void test_invalid_index(void)
+{
+    timer_wheel_init(&wheel, entries, NUM_ENTRIES, 0);
+    TEST_ASSERT_FALSE(timer_wheel_add(&wheel, NUM_ENTRIES, 1));
+    TEST_ASSERT_FALSE(timer_wheel_is_armed(&wheel, NUM_ENTRIES));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_expire_exact);
+    RUN_TEST(test_expire_across_32bit_wrap);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_rearm_moves_timer);
+    RUN_TEST(test_invalid_index);
+
+    UNITY_END();
+    return 0;
+}
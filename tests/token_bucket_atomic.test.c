@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "unity.h"
+#include "token_bucket_atomic.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+void test_init(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_FALSE(token_bucket_atomic_init(&limit, 0, 1000, 4));
+    TEST_ASSERT_FALSE(token_bucket_atomic_init(&limit, 1, 0, 4));
+    TEST_ASSERT_FALSE(token_bucket_atomic_init(&limit, 1, 1000, 0));
+    TEST_ASSERT_FALSE(token_bucket_atomic_init(&limit, 1, 1UL << 30, 2));
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1, 1UL << 30, 1));
+}
+
+// only allow one event every 10 sec (plus burst)
+void test_rate(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1, 10*1e6, 4));
+
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 5));
+    TEST_ASSERT_EQUAL(4, token_bucket_atomic_count_available(&limit));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 4));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+
+    delay_mock_add_micros(10*1e6 - 1);
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+    delay_mock_add_micros(1);
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 1));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+
+    // the burst is limited, even if a lot of time passes
+    delay_mock_add_micros(1000*1e6);
+    TEST_ASSERT_EQUAL(4, token_bucket_atomic_count_available(&limit));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 3));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 2));
+}
+
+// tokens refill one by one: 3 per 10 sec is one per 3.33 sec
+void test_rate__multiple_per_interval(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 3, 10*1e6, 10));
+
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 10));
+    delay_mock_add_micros(3333333);
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+    delay_mock_add_micros(1);
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 1));
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_EQUAL(3, token_bucket_atomic_count_available(&limit));
+}
+
+// the TAT is kept modulo 2^32 units: check it works across the wrap
+void test_rate__wrap(void)
+{
+    delay_mock_init();
+    delay_mock_add_micros(0xFFFFFFFFULL - 5);
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1, 10, 2));
+
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 2));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+    delay_mock_add_micros(10);
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 1));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+    delay_mock_add_micros(20);
+    TEST_ASSERT_EQUAL(2, token_bucket_atomic_count_available(&limit));
+}
+
+// a caller with an older timestamp than the one that set the TAT (e.g. it
+// was preempted) must not see a full bucket and move the TAT back
+void test_allowed_at_outdated(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1, 1000, 4));
+
+    const uint64_t old = delay_get_timestamp();
+    delay_mock_add_micros(100000);
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 4));
+
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed_at(&limit, 1, old));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+    TEST_ASSERT_EQUAL(0, token_bucket_atomic_count_available(&limit));
+
+    // with the current time, it is a normal limiter
+    delay_mock_add_micros(1000);
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed_at(&limit, 1,
+                delay_get_timestamp()));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed(&limit, 1));
+}
+
+// a stale TAT from a long idle time (more than 2^31 units) is a full bucket
+void test_idle_stale_tat(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1, 10, 2));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 2));
+
+    delay_mock_add_micros(0xC0000000ULL);
+    TEST_ASSERT_EQUAL(2, token_bucket_atomic_count_available(&limit));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed(&limit, 2));
+}
+
+
+// the same with an explicit timestamp: after about 0.6 * 2^32 units, the
+// stale TAT aliases to more than the burst ahead, but is not in the future
+void test_idle_stale_tat_at(void)
+{
+    delay_mock_init();
+    TokenBucketAtomic limit;
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&limit, 1000, 1000, 10));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed_at(&limit, 10,
+                delay_get_timestamp()));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed_at(&limit, 1,
+                delay_get_timestamp()));
+
+    // 0.6 * 2^32 units of 1/1000 us
+    delay_mock_add_micros(2576980);
+    TEST_ASSERT_EQUAL(10, token_bucket_atomic_count_available(&limit));
+    TEST_ASSERT_TRUE(token_bucket_atomic_allowed_at(&limit, 10,
+                delay_get_timestamp()));
+    TEST_ASSERT_FALSE(token_bucket_atomic_allowed_at(&limit, 1,
+                delay_get_timestamp()));
+}
+
+#define NUM_THREADS     (8)
+#define NUM_ATTEMPTS    (100000)
+
+static TokenBucketAtomic g_shared;
+
+static void *stress_thread(void *arg)
+{
+    unsigned int *allowed = arg;
+    for(int i=0; i < NUM_ATTEMPTS; i++) {
+        if(token_bucket_atomic_allowed(&g_shared, 1 + (i & 1))) {
+            *allowed+= 1 + (i & 1);
+        }
+    }
+    return NULL;
+}
+
+static unsigned int run_stress(void)
+{
+    pthread_t threads[NUM_THREADS];
+    unsigned int allowed[NUM_THREADS] = {0};
+    for(int i=0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, stress_thread, &allowed[i]);
+    }
+    unsigned int total = 0;
+    for(int i=0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total+= allowed[i];
+    }
+    return total;
+}
+
+// With the time frozen, many threads together may never get more than the
+// tokens in the bucket: no token is lost or granted twice.
+void test_stress_threads(void)
+{
+    delay_mock_init();
+    delay_mock_add_micros(12345);
+    TEST_ASSERT_TRUE(token_bucket_atomic_init(&g_shared, 10, 1000, 5000));
+
+    TEST_ASSERT_EQUAL(5000, run_stress());
+    TEST_ASSERT_EQUAL(0, token_bucket_atomic_count_available(&g_shared));
+
+    delay_mock_add_micros(1000);
+    TEST_ASSERT_EQUAL(10, run_stress());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init);
+    RUN_TEST(test_rate);
+    RUN_TEST(test_rate__multiple_per_interval);
+    RUN_TEST(test_rate__wrap);
+    RUN_TEST(test_allowed_at_outdated);
+    RUN_TEST(test_idle_stale_tat);
+    RUN_TEST(test_idle_stale_tat_at);
+    RUN_TEST(test_stress_threads);
+    UNITY_END();
+    return 0;
+}
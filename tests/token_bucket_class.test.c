@@ -0,0 +1,146 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "token_bucket_class.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+#define INTERVAL_US (1000000)
+#define STEP_US     (INTERVAL_US / 10)
+
+// link of 10 events/sec, class A assured 6, class B assured 4, both may use
+// the whole link
+static TokenBucketClass g_link;
+static TokenBucketClass g_a;
+static TokenBucketClass g_b;
+
+void setUp(void)
+{
+    delay_mock_init();
+    token_bucket_class_init(&g_link, NULL, 10, 10, INTERVAL_US, 10);
+    token_bucket_class_init(&g_a, &g_link, 6, 10, INTERVAL_US, 10);
+    token_bucket_class_init(&g_b, &g_link, 4, 10, INTERVAL_US, 10);
+}
+
+void tearDown(void) {}
+
+// Send as much as allowed on each class for 'seconds', return the totals
+static void run_greedy(int seconds, bool send_a, bool send_b,
+        unsigned int *count_a, unsigned int *count_b)
+{
+    *count_a = 0;
+    *count_b = 0;
+    for(int step=0; step < seconds * (INTERVAL_US / STEP_US); step++) {
+        delay_mock_add_micros(STEP_US);
+        while(send_a && token_bucket_class_allowed(&g_a, 1)) {
+            (*count_a)++;
+        }
+        while(send_b && token_bucket_class_allowed(&g_b, 1)) {
+            (*count_b)++;
+        }
+    }
+}
+
+// an idle class lends its capacity: A alone gets the whole link
+void test_borrow_from_idle(void)
+{
+    unsigned int a, b;
+    run_greedy(10, true, false, &a, &b);
+    TEST_ASSERT_UINT_WITHIN(10, 100, a);
+    TEST_ASSERT_TRUE(token_bucket_class_is_borrowing(&g_a));
+}
+
+// both busy: each gets its assured rate, the link is not exceeded
+void test_share_when_busy(void)
+{
+    unsigned int a, b;
+    run_greedy(1, true, true, &a, &b);   // use up the initial bursts
+    run_greedy(10, true, true, &a, &b);
+    TEST_ASSERT_UINT_WITHIN(6, 60, a);
+    TEST_ASSERT_UINT_WITHIN(4, 40, b);
+    TEST_ASSERT_UINT_WITHIN(10, 100, a + b);
+}
+
+// a class that borrowed does not starve the other one when it becomes busy
+void test_no_starvation(void)
+{
+    unsigned int a, b;
+    run_greedy(10, true, false, &a, &b);
+    run_greedy(10, true, true, &a, &b);
+    // B also sends the burst it saved up while idle
+    TEST_ASSERT_TRUE(b >= 40 - 4);
+    TEST_ASSERT_UINT_WITHIN(10, 100, a + b);
+}
+
+// the ceiling limits a class even when the link is idle
+void test_ceiling(void)
+{
+    token_bucket_class_init(&g_a, &g_link, 2, 5, INTERVAL_US, 5);
+    unsigned int a, b;
+    run_greedy(1, true, false, &a, &b);
+    run_greedy(10, true, false, &a, &b);
+    TEST_ASSERT_UINT_WITHIN(5, 50, a);
+}
+
+// all or nothing: a request larger than the burst is never allowed
+void test_all_or_nothing(void)
+{
+    TEST_ASSERT_FALSE(token_bucket_class_allowed(&g_a, 11));
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_a, 10));
+    TEST_ASSERT_TRUE(token_bucket_class_is_borrowing(&g_a));
+    TEST_ASSERT_EQUAL(0, token_bucket_limiter_count_available(&g_link.assured));
+}
+
+// assured traffic is allowed even if the link is used up: the link goes into
+// debt, so nobody can borrow until it is repaid
+void test_link_debt(void)
+{
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_a, 10));
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_b, 4));
+    TEST_ASSERT_EQUAL(4, g_link.assured_debt);
+
+    delay_mock_add_micros(INTERVAL_US);
+    TEST_ASSERT_FALSE(token_bucket_class_allowed(&g_a, 7));
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_b, 4));
+    TEST_ASSERT_EQUAL(0, g_link.assured_debt);
+}
+
+// debt larger than the burst is kept: it is all repaid before anyone can
+// borrow from the link again
+void test_link_debt_beyond_burst(void)
+{
+    token_bucket_class_init(&g_b, &g_link, 4, 10, INTERVAL_US, 20);
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_a, 10));
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_b, 20));
+    TEST_ASSERT_EQUAL(20, g_link.assured_debt);
+    TEST_ASSERT_EQUAL(20, g_link.ceiling_debt);
+
+    // a denied request repays debt from the refill so far
+    delay_mock_add_micros(INTERVAL_US);
+    TEST_ASSERT_FALSE(token_bucket_class_allowed(&g_a, 7));
+    TEST_ASSERT_EQUAL(10, g_link.assured_debt);
+    TEST_ASSERT_EQUAL(10, g_link.ceiling_debt);
+
+    // the rest is repaid, the link has no tokens left for B's assured event
+    delay_mock_add_micros(INTERVAL_US);
+    TEST_ASSERT_TRUE(token_bucket_class_allowed(&g_b, 1));
+    TEST_ASSERT_EQUAL(1, g_link.assured_debt);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_borrow_from_idle);
+    RUN_TEST(test_share_when_busy);
+    RUN_TEST(test_no_starvation);
+    RUN_TEST(test_ceiling);
+    RUN_TEST(test_all_or_nothing);
+    RUN_TEST(test_link_debt);
+    RUN_TEST(test_link_debt_beyond_burst);
+    UNITY_END();
+    return 0;
+}
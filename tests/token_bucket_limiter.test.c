@@ -149,6 +149,209 @@ void test_rate__allow_multiple_per_interval__one_by_one(void)
     TEST_ASSERT_FALSE(token_bucket_limiter_allowed(&limit, 1));
 }
 
+// the multiply-shift reciprocal is exact for every reachable micro token count
+void test_reciprocal_exhaustive(void)
+{
+    TokenBucketPolicy policy;
+    for(unsigned int n=1; n <= 3; n++) {
+        for(unsigned int interval=1; interval <= 1024; interval++) {
+            token_bucket_policy_init(&policy, n, interval, 16384);
+            TEST_ASSERT_NOT_EQUAL(0, policy.recip_mul);
+
+            const uint64_t divisor = n * interval;
+            for(uint64_t micro=0; micro < 16384; micro++) {
+                if(token_bucket_policy_divide(&policy, micro)
+                        != (micro / divisor)) {
+                    TEST_ASSERT_EQUAL(micro / divisor,
+                            token_bucket_policy_divide(&policy, micro));
+                }
+            }
+        }
+    }
+}
+
+// large divisors: check around each multiple and the end of the range
+void test_reciprocal_large(void)
+{
+    const unsigned int intervals[] = {
+        0xFFFFFFFF, 0x80000000, 0x80000001, 0x7FFFFFFF,
+        3000000000U, 123456789, 1000000, 65537, 10007,
+    };
+    TokenBucketPolicy policy;
+    for(size_t i=0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        token_bucket_policy_init(&policy, 1, intervals[i], 1000);
+        const uint64_t divisor = intervals[i];
+
+        for(uint64_t k=0; (k * divisor) <= UINT32_MAX; k++) {
+            for(int d=-2; d <= 2; d++) {
+                const uint64_t micro = (k * divisor) + d;
+                if(micro > UINT32_MAX) {
+                    continue;
+                }
+                TEST_ASSERT_EQUAL(micro / divisor,
+                        token_bucket_policy_divide(&policy, micro));
+            }
+            if(k >= 5000) {
+                break;
+            }
+        }
+        TEST_ASSERT_EQUAL(UINT32_MAX / divisor,
+                token_bucket_policy_divide(&policy, UINT32_MAX));
+        TEST_ASSERT_EQUAL((UINT32_MAX + 1ULL) / divisor,
+                token_bucket_policy_divide(&policy, UINT32_MAX + 1ULL));
+    }
+
+    // does not fit in 32 bits: falls back to division
+    token_bucket_policy_init(&policy, 2, 0xFFFFFFFF, 1000);
+    TEST_ASSERT_EQUAL(0, policy.recip_mul);
+    TEST_ASSERT_EQUAL(1, token_bucket_policy_divide(&policy, 0x1FFFFFFFEULL));
+}
+
+// The refill arithmetic before the reciprocal was introduced
+// (with scaled_n_per_req widened to 64 bits)
+static void reference_refill(const TokenBucketPolicy *policy,
+        unsigned int *available_tokens, uint64_t *micro_tokens,
+        uint64_t elapsed_us)
+{
+    const unsigned int n_per_req = policy->num_req_per_interval;
+    const uint64_t scale_factor = policy->interval_us;
+
+    const uint64_t new_u_tokens = elapsed_us * n_per_req;
+    const uint64_t max_new = ((policy->max_tokens - *available_tokens)
+        * scale_factor);
+
+    if(new_u_tokens > max_new) {
+        *micro_tokens = max_new;
+    } else if((max_new - new_u_tokens) < *micro_tokens) {
+        *micro_tokens = max_new;
+    } else {
+        *micro_tokens+= new_u_tokens;
+    }
+
+    const uint64_t scaled_n_per_req = n_per_req * scale_factor;
+    const unsigned int available = n_per_req * (*micro_tokens / scaled_n_per_req);
+    *micro_tokens-= (available * scale_factor);
+    *available_tokens+= available;
+}
+
+static uint32_t g_random = 12345;
+static uint32_t next_random(uint32_t max)
+{
+    g_random = (g_random * 1103515245UL) + 12345;
+    return (g_random >> 8) % (max + 1);
+}
+
+void test_refill_same_as_reference(void)
+{
+    for(int p=0; p < 2000; p++) {
+        TokenBucketPolicy policy;
+        token_bucket_policy_init(&policy, 1 + next_random(20),
+                1 + next_random((p & 1) ? 100 : 10000000),
+                1 + next_random(50));
+
+        unsigned int available = next_random(policy.max_tokens);
+        uint64_t micro = 0;
+        unsigned int ref_available = available;
+        uint64_t ref_micro = micro;
+
+        for(int step=0; step < 200; step++) {
+            const uint64_t elapsed = next_random(policy.interval_us * 2);
+            token_bucket_policy_refill(&policy, &available, &micro, elapsed);
+            reference_refill(&policy, &ref_available, &ref_micro, elapsed);
+            TEST_ASSERT_EQUAL(ref_available, available);
+            TEST_ASSERT_EQUAL(ref_micro, micro);
+
+            // claim some tokens
+            const unsigned int claim = next_random(available);
+            available-= claim;
+            ref_available-= claim;
+        }
+    }
+}
+
+// partial grants: claim what is available, in one call
+void test_claim_up_to(void)
+{
+    delay_mock_init();
+    TokenBucketLimiter limit;
+    token_bucket_limiter_init(&limit, 2, 10*1e6, 8);
+
+    TEST_ASSERT_EQUAL(5, token_bucket_limiter_claim_up_to(&limit, 5));
+    TEST_ASSERT_EQUAL(3, token_bucket_limiter_claim_up_to(&limit, 5));
+    TEST_ASSERT_EQUAL(0, token_bucket_limiter_claim_up_to(&limit, 5));
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_EQUAL(2, token_bucket_limiter_claim_up_to(&limit, 5));
+    TEST_ASSERT_EQUAL(0, token_bucket_limiter_count_available(&limit));
+}
+
+// reserve/commit: unused events are returned, up to the burst limit
+void test_reserve_commit(void)
+{
+    delay_mock_init();
+    TokenBucketLimiter limit;
+    token_bucket_limiter_init(&limit, 2, 10*1e6, 8);
+
+    TEST_ASSERT_EQUAL(6, token_bucket_limiter_reserve(&limit, 6));
+    TEST_ASSERT_EQUAL(2, token_bucket_limiter_count_available(&limit));
+    token_bucket_limiter_commit(&limit, 4);
+    TEST_ASSERT_EQUAL(4, token_bucket_limiter_count_available(&limit));
+
+    // commit more than reserved: only the reservation is used
+    TEST_ASSERT_EQUAL(4, token_bucket_limiter_reserve(&limit, 6));
+    token_bucket_limiter_commit(&limit, 10);
+    TEST_ASSERT_EQUAL(0, token_bucket_limiter_count_available(&limit));
+
+    // the bucket refills while the transfer runs: never above the burst
+    delay_mock_add_micros(30*1e6);
+    TEST_ASSERT_EQUAL(6, token_bucket_limiter_reserve(&limit, 10));
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_EQUAL(2, token_bucket_limiter_count_available(&limit));
+    token_bucket_limiter_commit(&limit, 0);
+    TEST_ASSERT_EQUAL(8, token_bucket_limiter_count_available(&limit));
+}
+
+// explicit timestamps: one timer read shared by several limiters
+void test_allowed_at(void)
+{
+    delay_mock_init();
+    TokenBucketLimiter a, b;
+    token_bucket_limiter_init(&a, 1, 10*1e6, 2);
+    token_bucket_limiter_init(&b, 1, 10*1e6, 2);
+
+    delay_mock_add_micros(1);
+    TEST_ASSERT_TRUE(token_bucket_limiter_allowed(&a, 2));
+    TEST_ASSERT_TRUE(token_bucket_limiter_allowed(&b, 2));
+
+    delay_mock_add_micros(10*1e6);
+    const uint64_t now = delay_get_timestamp();
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_TRUE(token_bucket_limiter_allowed_at(&a, 1, now));
+    TEST_ASSERT_FALSE(token_bucket_limiter_allowed_at(&a, 1, now));
+    TEST_ASSERT_EQUAL(1, token_bucket_limiter_count_available_at(&b, now));
+
+    // an older timestamp does not refill (or move the limiter back in time)
+    TEST_ASSERT_EQUAL(0, token_bucket_limiter_claim_up_to_at(&a, 2, 0));
+    TEST_ASSERT_EQUAL(1, token_bucket_limiter_count_available(&a));
+}
+
+// polling more often than once per microsecond: the partial microseconds
+// are not lost (the mock timer has 3 ticks per microsecond)
+void test_refill_sub_microsecond_polling(void)
+{
+    delay_mock_init();
+    TokenBucketLimiter limit;
+    token_bucket_limiter_init(&limit, 1, 10, 1);
+    TEST_ASSERT_TRUE(token_bucket_limiter_allowed(&limit, 1));
+
+    uint64_t now = delay_get_timestamp();
+    for(int i=0; i < 29; i++) {
+        now+= 1;
+        TEST_ASSERT_FALSE(token_bucket_limiter_allowed_at(&limit, 1, now));
+    }
+    // 30 ticks: 10 microseconds
+    now+= 1;
+    TEST_ASSERT_TRUE(token_bucket_limiter_allowed_at(&limit, 1, now));
+}
 
 int main(void)
 {
@@ -160,6 +363,13 @@ int main(void)
     RUN_TEST(test_rate__rounding);
     RUN_TEST(test_rate__allow_multiple_per_interval);
     RUN_TEST(test_rate__allow_multiple_per_interval__one_by_one);
+    RUN_TEST(test_reciprocal_exhaustive);
+    RUN_TEST(test_reciprocal_large);
+    RUN_TEST(test_refill_same_as_reference);
+    RUN_TEST(test_claim_up_to);
+    RUN_TEST(test_reserve_commit);
+    RUN_TEST(test_allowed_at);
+    RUN_TEST(test_refill_sub_microsecond_polling);
 
     UNITY_END();
     return 0;
@@ -0,0 +1,114 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "token_bucket_table.h"
+
+#include "mocks/mock_logging.c"
+#include "mocks/mock_delay.c"
+
+#define CAPACITY (16)
+
+static uint64_t g_storage[TOKEN_BUCKET_TABLE_STORAGE_WORDS(CAPACITY)];
+static TokenBucketPolicy g_policy;
+static TokenBucketTable g_table;
+
+void setUp(void)
+{
+    delay_mock_init();
+    // 1 event per 10 sec, burst of 4
+    token_bucket_policy_init(&g_policy, 1, 10*1e6, 4);
+    TEST_ASSERT_TRUE(token_bucket_table_init(&g_table, &g_policy,
+                g_storage, CAPACITY));
+}
+
+void tearDown(void) {}
+
+void test_init_capacity(void)
+{
+    TokenBucketTable table;
+    TEST_ASSERT_FALSE(token_bucket_table_init(&table, &g_policy, g_storage, 0));
+    TEST_ASSERT_FALSE(token_bucket_table_init(&table, &g_policy, g_storage, 12));
+}
+
+// each key has its own bucket
+void test_keys_independent(void)
+{
+    TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, 1, 4));
+    TEST_ASSERT_FALSE(token_bucket_table_allowed(&g_table, 1, 1));
+
+    TEST_ASSERT_EQUAL(4, token_bucket_table_count_available(&g_table, 2));
+    TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, 2, 3));
+    TEST_ASSERT_EQUAL(1, token_bucket_table_count_available(&g_table, 2));
+    TEST_ASSERT_EQUAL(2, token_bucket_table_count(&g_table));
+
+    delay_mock_add_micros(10*1e6);
+    TEST_ASSERT_EQUAL(1, token_bucket_table_count_available(&g_table, 1));
+    TEST_ASSERT_EQUAL(2, token_bucket_table_count_available(&g_table, 2));
+    TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, 1, 1));
+    TEST_ASSERT_FALSE(token_bucket_table_allowed(&g_table, 1, 1));
+}
+
+// the table behaves like a TokenBucketLimiter per key
+void test_same_as_limiter(void)
+{
+    TokenBucketLimiter limiter;
+    token_bucket_limiter_init(&limiter, 3, 1000, 5);
+    TokenBucketPolicy policy = limiter.policy;
+    token_bucket_table_init(&g_table, &policy, g_storage, CAPACITY);
+
+    for(int i=0; i < 200; i++) {
+        const unsigned int n = (i * 7) % 4;
+        TEST_ASSERT_EQUAL(token_bucket_limiter_allowed(&limiter, n),
+                token_bucket_table_allowed(&g_table, 1234, n));
+        delay_mock_add_micros((i * 37) % 500);
+    }
+}
+
+void test_remove(void)
+{
+    TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, 7, 4));
+    TEST_ASSERT_TRUE(token_bucket_table_remove(&g_table, 7));
+    TEST_ASSERT_FALSE(token_bucket_table_remove(&g_table, 7));
+    TEST_ASSERT_EQUAL(0, token_bucket_table_count(&g_table));
+
+    // a forgotten key starts with a full bucket
+    TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, 7, 4));
+}
+
+void test_reserved_key(void)
+{
+    TEST_ASSERT_FALSE(token_bucket_table_allowed(&g_table,
+                TOKEN_BUCKET_TABLE_EMPTY, 1));
+    TEST_ASSERT_EQUAL(0, token_bucket_table_count(&g_table));
+}
+
+// when full, the least recently used key is evicted
+void test_evict_lru(void)
+{
+    for(uint32_t key=0; key < 200; key++) {
+        TEST_ASSERT_TRUE(token_bucket_table_allowed(&g_table, key, 1));
+        delay_mock_add_micros(1);
+    }
+    TEST_ASSERT_EQUAL(CAPACITY, token_bucket_table_count(&g_table));
+    TEST_ASSERT_EQUAL(200 - CAPACITY, g_table.evictions);
+
+    // the most recent key is still limited, an old key is not
+    TEST_ASSERT_EQUAL(3, token_bucket_table_count_available(&g_table, 199));
+    TEST_ASSERT_EQUAL(4, token_bucket_table_count_available(&g_table, 0));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_capacity);
+    RUN_TEST(test_keys_independent);
+    RUN_TEST(test_same_as_limiter);
+    RUN_TEST(test_remove);
+    RUN_TEST(test_reserved_key);
+    RUN_TEST(test_evict_lru);
+    UNITY_END();
+    return 0;
+}
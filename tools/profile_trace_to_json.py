@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Convert a binary profile trace (see mcu_timing/profile_trace.h) to the
+Chrome trace event format, which can be opened in Perfetto
+(https://ui.perfetto.dev) or chrome://tracing.
+
+Usage: profile_trace_to_json.py <dump.bin> [output.json]
+"""
+import json
+import struct
+import sys
+
+MAGIC = 0x43525450
+VERSION = 1
+
+HEADER = struct.Struct('<IHHIII')
+
+INDEX_SHIFT = 22
+END_BIT = 1 << 21
+TIME_BITS = 21
+TIME_MASK = (1 << TIME_BITS) - 1
+SYNC = 0x3FF
+UNKNOWN = 0x3FE
+
+
+def parse(data):
+    magic, version, _, ticks_per_second, num_records, num_labels = \
+        HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError('not a profile trace (bad magic)')
+    if version != VERSION:
+        raise ValueError('unsupported trace version %d' % version)
+
+    offset = HEADER.size
+    records = struct.unpack_from('<%dI' % num_records, data, offset)
+    offset += 4 * num_records
+
+    labels = []
+    for _ in range(num_labels):
+        (length,) = struct.unpack_from('<H', data, offset)
+        offset += 2
+        labels.append(data[offset:offset + length].decode('utf-8', 'replace'))
+        offset += length
+
+    return ticks_per_second, records, labels
+
+
+def decode(records):
+    """Yield (index, is_end, timestamp in ticks) for each event."""
+    sync_high = None
+    timestamp = None
+    for record in records:
+        index = record >> INDEX_SHIFT
+        if index == SYNC:
+            sync_high = record & ((1 << INDEX_SHIFT) - 1)
+            continue
+
+        low = record & TIME_MASK
+        if sync_high is not None:
+            timestamp = (sync_high << TIME_BITS) | low
+            sync_high = None
+        elif timestamp is not None:
+            # records are not strictly ordered in time (interrupts),
+            # so the delta is signed
+            delta = (low - timestamp) & TIME_MASK
+            if delta >= (1 << (TIME_BITS - 1)):
+                delta -= (1 << TIME_BITS)
+            timestamp += delta
+        else:
+            # the oldest records were overwritten: wait for the first sync
+            continue
+
+        yield index, bool(record & END_BIT), timestamp
+
+
+def to_chrome_trace(ticks_per_second, records, labels):
+    events = []
+    for index, is_end, timestamp in decode(records):
+        if index < len(labels):
+            name = labels[index]
+        elif index == UNKNOWN:
+            name = '<unknown>'
+        else:
+            name = 'profile %d' % index
+        events.append({
+            'name': name,
+            'ph': 'E' if is_end else 'B',
+            'ts': timestamp * 1e6 / ticks_per_second,
+            'pid': 0,
+            'tid': 0,
+        })
+    return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit(__doc__.strip())
+
+    with open(sys.argv[1], 'rb') as f:
+        trace = to_chrome_trace(*parse(f.read()))
+
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as f:
+            json.dump(trace, f, indent=1)
+    else:
+        json.dump(trace, sys.stdout, indent=1)
+
+
+if __name__ == '__main__':
+    main()